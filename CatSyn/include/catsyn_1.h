@@ -12,11 +12,157 @@ class IPathway : virtual public IObject {
 class IFactory1 : virtual public IFactory {
   public:
     virtual void create_pathway(IPathway** out) noexcept = 0;
+    // read-only window into [offset, offset + len) of parent; copied out on first write if parent is shared
+    virtual void create_bytes_view(const IBytes* parent, size_t offset, size_t len, IBytes** out) noexcept = 0;
 };
 
+struct PlanePoolStats {
+    size_t hits;
+    size_t misses;
+    size_t drops;
+    size_t cached_bytes;
+};
+
+struct SubstrateStats {
+    size_t frames_processed;
+    // process_frame time in nanoseconds; percentiles are interpolated from a log2 histogram
+    uint64_t process_ns;
+    uint64_t process_ns_p50;
+    uint64_t process_ns_p90;
+    uint64_t process_ns_p99;
+    // nanoseconds between all inputs being ready and a worker picking the frame up
+    uint64_t queue_wait_ns;
+    size_t recomputes;
+    size_t bytes_produced;
+    size_t in_flight;
+};
+
+class IStats : virtual public IRef {
+  public:
+    virtual size_t size() const noexcept = 0;
+    virtual const ISubstrate* get_substrate(size_t idx) const noexcept = 0;
+    virtual SubstrateStats get(size_t idx) const noexcept = 0;
+};
+
+enum ReactionFlags : unsigned {
+    rfNormal = 0,
+    rfWorkStealing = 1,
+    rfRealtime = 2,
+    rfTrace = 4,
+    rfCriticalPath = 8,
+};
+
+enum AffinityMode {
+    amNone = 0,
+    amSpread = 1,
+    amPack = 2,
+};
+
+// NucleusConfig with the knobs added since; zero picks the default, like in NucleusConfig
+struct NucleusConfig1 {
+    unsigned thread_count;
+    unsigned mem_hint_mb;
+    // ReactionFlags combined with |
+    unsigned reaction_flags;
+    unsigned maintainer_count;
+    AffinityMode affinity;
+    // threads delivering callbacks, by default a quarter of the thread count and at least 2; the callbacks of one
+    // output are delivered by the same thread, in order
+    unsigned callback_count;
+};
+
+class INucleus1 : virtual public INucleus {
+  public:
+    using INucleus::get_config;
+    using INucleus::set_config;
+    virtual void set_config(NucleusConfig1 config) noexcept = 0;
+    virtual void get_config(NucleusConfig1* out) const noexcept = 0;
+    // counters are flushed from per-thread magazines lazily, so they may lag behind slightly
+    virtual PlanePoolStats get_plane_pool_stats() const noexcept = 0;
+    // Chrome trace event JSON of what has been recorded so far; empty unless reacting with rfTrace
+    virtual void export_trace(IBytes** out) noexcept = 0;
+    // snapshot of the statistics of every registered substrate
+    virtual void collect_stats(IStats** out) noexcept = 0;
+    // Calls band(user_data, idx) for every idx in [0, count) and returns once all calls have finished. Called from
+    // process_frame, the bands are shared with idle workers; elsewhere they run on the calling thread. The first
+    // exception thrown by a band is rethrown after all bands have finished.
+    virtual void run_bands(unsigned count, void (*band)(void* user_data, unsigned idx), void* user_data) = 0;
+    // Called from process_frame once input_frames[idx] is not read any more, so the input may be evicted before
+    // process_frame returns. Ignored elsewhere, including process_frames.
+    virtual void release_input(size_t idx) noexcept = 0;
+};
+
+// passed to the callback of a cancelled request
+struct FrameCancelled : std::exception {
+    const char* what() const noexcept final {
+        return "frame request cancelled";
+    }
+};
+
+class IRequest : virtual public IRef {
+  public:
+    // The callback is invoked with FrameCancelled unless the frame has already been delivered. Work that no other
+    // request needs is dropped. Cancelling more than once has no effect.
+    virtual void cancel() noexcept = 0;
+};
+
+// Frames of a range in order, with a fixed number of them requested ahead. A frame is only requested once the one
+// window frames before it has been taken, so the frames buffered and in flight never exceed the window.
+class IOutputStream : virtual public IRef {
+  public:
+    // Waits for the next frame and rethrows the exception of a failed frame, which is skipped. Returns false at the
+    // end of the range. Not to be called from a filter.
+    virtual bool next(const IFrame** out) = 0;
+};
+
+class IOutput1 : virtual public IOutput {
+  public:
+    using IOutput::get_frame;
+    // like get_frame, but the request can be withdrawn through the returned handle
+    virtual void get_frame(size_t frame_idx, ICallback* cb, IRequest** request) noexcept = 0;
+    // Waits for the frame on the calling thread and rethrows the exception of a failed frame. The result is handed
+    // over directly by the worker producing the frame, or by the maintainer for a cached one, without going through a
+    // callback thread. Not to be called from a filter.
+    virtual void get_frame_blocking(size_t frame_idx, const IFrame** out) = 0;
+    // Once frames are requested in order, frames ahead of the requests are constructed at the priority they would
+    // get when requested. The lookahead adapts to idle workers and the memory budget, up to max_window frames;
+    // 0 disables prefetching. It defaults to twice the thread count.
+    virtual void set_prefetch(size_t max_window) noexcept = 0;
+    // Invokes the callbacks right on the worker completing the frame instead of handing them to a callback thread.
+    // They are called in no particular order, must return quickly and never block on another frame. Callbacks of
+    // cached, cancelled or otherwise unprocessed frames still go through a callback thread.
+    virtual void set_inline_callbacks(bool enable) noexcept = 0;
+    // streams the frames in [first, last) with window frames requested at a time, bypassing prefetching
+    virtual void create_stream(size_t first, size_t last, size_t window, IOutputStream** out) noexcept = 0;
+};
+
+// Multi-round dependencies: when a filter only learns some of its inputs from other input frames, process_frame
+// returns with *out null and *frame_data still pointing to the frame data, whose dependencies now continue after the
+// ones given so far. These are linked like the initial ones, and process_frame is called again with the frames of
+// all dependencies once they are ready.
 class IFilter1 : virtual public IFilter {
   public:
     virtual std::atomic_uint* get_thread_init_atomic() noexcept = 0;
 };
 
+class IFilter2 : virtual public IFilter {
+  public:
+    // most frames passed to one process_frames call; 1 disables batching
+    virtual unsigned get_max_batch() const noexcept = 0;
+    // Like count calls of process_frame: the i-th frame is frame_indices[i] with input frames input_frames[i], frame
+    // data frame_data[i] and product out[i]. Workers batch ready frames of the same substrate that are queued together,
+    // in no particular order, and fall back to process_frame for a single frame. If it throws, every frame fails.
+    virtual void process_frames(size_t count, const size_t* frame_indices, const IFrame* const* const* input_frames,
+                                FrameData** frame_data, const IFrame** out) const = 0;
+};
+
+// FilterFlags added since, combined with those of FilterFlags
+enum FilterFlags1 {
+    // the ready frames of an ffSingleThreaded filter run in frame order instead of the order they were requested in
+    ffFrameOrdered = 2,
+    // a frame of an ffSingleThreaded filter that returns no product runs all its further rounds before any other frame
+    // of the filter starts, so the calls for different frames are never interleaved
+    ffSerialRounds = 16,
+};
+
 } // namespace catsyn
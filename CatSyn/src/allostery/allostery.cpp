@@ -4,6 +4,8 @@
 #include <Windows.h>
 #include <immintrin.h>
 #include <intrin.h>
+#else
+#include <immintrin.h>
 #endif
 
 #include <allostery.h>
@@ -127,10 +129,27 @@ void* re_alloc(void* ptr, size_t new_size) noexcept {
 #ifdef ALLOSTERY_IMPL
 
 #include <atomic>
+#include <bit>
 #include <chrono>
 #include <stack>
 #include <vector>
 
+#ifndef _WIN32
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+#endif
+
 #include <boost/lockfree/stack.hpp>
 
 #include <mimalloc.h>
@@ -141,7 +160,7 @@ static class Pool {
   public:
     static constexpr size_t num_size_classes = 16;
     static constexpr size_t size_class_offset = 12;
-    static constexpr size_t base = 0x700000000000ull;
+    static constexpr size_t preferred_base = 0x700000000000ull;
     static constexpr size_t bin = 0x2000000000ull;
     static constexpr size_t large_page_min = 0x200000ull;
 
@@ -152,7 +171,14 @@ static class Pool {
 
     Stack stacks[num_size_classes];
     std::atomic_size_t cur[num_size_classes];
+    // start of the reserved bins; 0 if no address space could be reserved, leaving every allocation to mimalloc
+    size_t base = 0;
+#ifdef _WIN32
     HANDLE notification_handle, wait_handle;
+#else
+    int stop_fd;
+    std::thread watcher;
+#endif
 
     static size_t size_to_size_class(size_t size) noexcept {
         auto size_class = std::bit_width(size - 1) - size_class_offset;
@@ -164,7 +190,61 @@ static class Pool {
         return 1 << size_class_offset << size_class;
     }
 
-    static void CALLBACK low_memory(PVOID pl, BOOLEAN) {
+#ifndef _WIN32
+    // Kernels before 4.17 ignore MAP_FIXED_NOREPLACE and may put the reservation elsewhere, which is given back then.
+    // The bins are reserved anywhere instead, aligned to a bin so that the blocks stay aligned for huge pages.
+    static size_t reserve() noexcept {
+        constexpr auto size = bin * num_size_classes;
+        auto p = mmap(reinterpret_cast<void*>(preferred_base), size, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED_NOREPLACE, -1, 0);
+        if (p == reinterpret_cast<void*>(preferred_base))
+            return preferred_base;
+        if (p != MAP_FAILED)
+            munmap(p, size);
+        p = mmap(nullptr, size + bin, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (p == MAP_FAILED)
+            return 0;
+        auto start = reinterpret_cast<size_t>(p);
+        auto aligned = (start + bin - 1) & ~(bin - 1);
+        if (aligned != start)
+            munmap(p, aligned - start);
+        munmap(reinterpret_cast<void*>(aligned + size), start + bin - aligned);
+        return aligned;
+    }
+#endif
+
+    static void commit_block(void* p, size_t size) noexcept {
+#ifdef _WIN32
+        cond_check(VirtualAlloc(p, size, MEM_COMMIT | (size >= large_page_min ? MEM_LARGE_PAGES : 0),
+                                PAGE_READWRITE) == p,
+                   "alloc failed");
+#else
+        if (size >= large_page_min) {
+            if (mmap(p, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB, -1, 0) ==
+                p)
+                return;
+            // no reserved huge pages; a failed MAP_FIXED may have punched a hole, so map the block over again
+            cond_check(mmap(p, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == p,
+                       "alloc failed");
+            madvise(p, size, MADV_HUGEPAGE);
+        } else
+            cond_check(mprotect(p, size, PROT_READ | PROT_WRITE) == 0, "alloc failed");
+#endif
+    }
+
+    static void reset_block(void* p, size_t size) noexcept {
+#ifdef _WIN32
+        // https://devblogs.microsoft.com/oldnewthing/20170113-00/?p=95185
+        VirtualAlloc(p, size, MEM_RESET, PAGE_READWRITE);
+        VirtualUnlock(p, size);
+#else
+        // MADV_FREE is unavailable before Linux 4.5 and on hugetlb mappings
+        if (madvise(p, size, MADV_FREE) != 0)
+            madvise(p, size, MADV_DONTNEED);
+#endif
+    }
+
+    void trim() noexcept {
         static uint64_t last_time = 0;
         uint64_t cur_time =
             std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch())
@@ -172,14 +252,11 @@ static class Pool {
         if (cur_time - last_time > 8) {
             last_time = cur_time;
             format_to_err("MEMORY LOW\n");
-            auto self = static_cast<Pool*>(pl);
             std::stack<void*, std::vector<void*, mi_stl_allocator<void*>>> temp;
             for (size_t size_class = 0; size_class < num_size_classes; ++size_class) {
-                auto& stack = self->stacks[size_class];
+                auto& stack = stacks[size_class];
                 stack.consume_all([&temp, size_class](void* p) {
-                    // https://devblogs.microsoft.com/oldnewthing/20170113-00/?p=95185
-                    VirtualAlloc(p, size_class_to_size(size_class), MEM_RESET, PAGE_READWRITE);
-                    VirtualUnlock(p, size_class_to_size(size_class));
+                    reset_block(p, size_class_to_size(size_class));
                     temp.push(p);
                 });
                 while (!temp.empty()) {
@@ -190,8 +267,88 @@ static class Pool {
         }
     }
 
+#ifdef _WIN32
+    static void CALLBACK low_memory(PVOID pl, BOOLEAN) {
+        static_cast<Pool*>(pl)->trim();
+    }
+#else
+    static int open_psi() noexcept {
+        auto fd = open("/proc/pressure/memory", O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0)
+            return -1;
+        // 150ms of stall in a 2s window; unprivileged triggers need the window to be a multiple of 2s
+        static constexpr char trigger[] = "some 150000 2000000";
+        if (write(fd, trigger, sizeof(trigger)) < 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    static int open_cgroup_events() noexcept {
+        auto fd = open("/proc/self/cgroup", O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return -1;
+        char buf[4096];
+        auto len = read(fd, buf, sizeof(buf) - 1);
+        close(fd);
+        if (len <= 0)
+            return -1;
+        buf[len] = 0;
+        // only the unified hierarchy ("0::/path") exposes memory.events
+        auto line = std::strstr(buf, "0::");
+        if (!line || (line != buf && line[-1] != '\n'))
+            return -1;
+        line += 3;
+        if (auto end = std::strchr(line, '\n'); end)
+            *end = 0;
+        char path[4096 + 64];
+        std::snprintf(path, sizeof(path), "/sys/fs/cgroup%s/memory.events", line);
+        return open(path, O_RDONLY | O_CLOEXEC);
+    }
+
+    static size_t read_cgroup_events(int fd) noexcept {
+        char buf[512];
+        auto len = pread(fd, buf, sizeof(buf) - 1, 0);
+        if (len <= 0)
+            return 0;
+        buf[len] = 0;
+        size_t count = 0;
+        for (auto key : {"\nhigh ", "\nmax ", "\noom "})
+            if (auto p = std::strstr(buf, key); p)
+                count += std::strtoull(p + std::strlen(key), nullptr, 10);
+        return count;
+    }
+
+    void watch(int fd, bool psi) noexcept {
+        auto events = psi ? 0 : read_cgroup_events(fd);
+        pollfd fds[2] = {{fd, POLLPRI, 0}, {stop_fd, POLLIN, 0}};
+        for (;;) {
+            if (poll(fds, 2, -1) < 0) {
+                if (errno == EINTR)
+                    continue;
+                break;
+            }
+            if (fds[1].revents)
+                break;
+            if (fds[0].revents & POLLPRI) {
+                if (psi)
+                    trim();
+                else if (auto new_events = read_cgroup_events(fd); new_events != events) {
+                    events = new_events;
+                    trim();
+                }
+            } else if (fds[0].revents & (POLLERR | POLLNVAL))
+                break;
+        }
+        close(fd);
+    }
+#endif
+
   public:
     Pool() noexcept {
+#ifdef _WIN32
+        base = preferred_base;
         cond_check(reinterpret_cast<size_t>(VirtualAlloc(reinterpret_cast<void*>(base), bin * num_size_classes,
                                                          MEM_RESERVE, PAGE_READWRITE)) == base,
                    "alloc failed");
@@ -210,12 +367,36 @@ static class Pool {
         notification_handle = CreateMemoryResourceNotification(LowMemoryResourceNotification);
         RegisterWaitForSingleObject(&wait_handle, notification_handle, low_memory, this, INFINITE,
                                     WT_EXECUTEINWAITTHREAD);
+#else
+        base = reserve();
+
+        stop_fd = eventfd(0, EFD_CLOEXEC);
+        bool psi = true;
+        auto fd = open_psi();
+        if (fd < 0) {
+            psi = false;
+            fd = open_cgroup_events();
+        }
+        if (fd >= 0)
+            watcher = std::thread(&Pool::watch, this, fd, psi);
+#endif
     }
 
     ~Pool() {
+#ifdef _WIN32
         CloseHandle(wait_handle);
         CloseHandle(notification_handle);
         VirtualFree(reinterpret_cast<void*>(base), 0, MEM_RELEASE);
+#else
+        if (watcher.joinable()) {
+            uint64_t one = 1;
+            system_call_check(write(stop_fd, &one, sizeof(one)) == sizeof(one));
+            watcher.join();
+        }
+        close(stop_fd);
+        if (base)
+            munmap(reinterpret_cast<void*>(base), bin * num_size_classes);
+#endif
     }
 
     size_t alloc_size(void* ptr) noexcept {
@@ -234,9 +415,7 @@ static class Pool {
         offset *= round_size;
         cond_check(offset < bin, "pool exhausted");
         p = reinterpret_cast<void*>(base + bin * size_class + offset);
-        cond_check(VirtualAlloc(p, round_size, MEM_COMMIT | (round_size >= large_page_min ? MEM_LARGE_PAGES : 0),
-                                PAGE_READWRITE) == p,
-                   "alloc failed");
+        commit_block(p, round_size);
         return p;
     }
 
@@ -249,15 +428,22 @@ static class Pool {
 
     bool own_ptr(void* ptr) noexcept {
         auto pv = reinterpret_cast<size_t>(ptr);
-        return pv >= base && pv < base + bin * num_size_classes;
+        return base && pv >= base && pv < base + bin * num_size_classes;
+    }
+
+    bool reserved() const noexcept {
+        return base;
     }
 } pool;
 
 ALLOSTERY_API void* alloc(size_t size) {
-    if (size >= 1 << Pool::size_class_offset)
+    if (size < 1 << Pool::size_class_offset)
+        return mi_malloc(size);
+    else if (pool.reserved())
         return pool.alloc(size);
     else
-        return mi_malloc(size);
+        // page aligned like the blocks of the pool
+        return mi_malloc_aligned(size, 1 << Pool::size_class_offset);
 }
 
 ALLOSTERY_API void dealloc(void* ptr) {
@@ -1,3 +1,7 @@
+#pragma once
+
+#include <cstddef>
+
 size_t round_size(size_t size) noexcept;
 void round_copy(void* __restrict dst, const void* __restrict src, size_t size) noexcept;
 void* re_alloc(void* ptr, size_t new_size) noexcept;
@@ -2,7 +2,9 @@
 
 #include <functional>
 #include <map>
+#include <mutex>
 #include <optional>
+#include <set>
 #include <string>
 #include <thread>
 #include <variant>
@@ -60,7 +62,10 @@ class JThread final : public std::jthread {
 };
 
 class Logger final : public Object, virtual public ILogger {
-    mutable SCQueue<uintptr_t> queue;
+    // longer messages are truncated
+    static constexpr size_t max_message = 4096;
+
+    mutable ByteRing ring;
     cat_ptr<ILogSink> sink;
     LogLevel filter_level;
     JThread thread;
@@ -94,45 +99,238 @@ class Table final : public Object, public virtual ITable {
     size_t prev(size_t ref) const noexcept final;
 };
 
+// written by one worker each (unless there are more workers than slots), summed up only when stats are collected
+struct alignas(64) WorkerCounters {
+    static constexpr unsigned histogram_size = 48;
+
+    std::atomic_uint64_t frames{0};
+    std::atomic_uint64_t process_ns{0};
+    std::atomic_uint64_t wait_ns{0};
+    // bucket b counts process_frame times whose bit width is b
+    std::atomic_uint32_t histogram[histogram_size]{};
+};
+
+struct FrameInstance;
+struct FrameInstanceTickGreater {
+    bool operator()(const FrameInstance* l, const FrameInstance* r) const noexcept;
+};
+struct FrameInstancePriorityGreater {
+    bool operator()(const FrameInstance* l, const FrameInstance* r) const noexcept;
+};
+// FrameInstanceTickGreater, or by frame number first for ffFrameOrdered filters
+struct FrameInstanceSerialGreater {
+    bool frame_ordered;
+    bool operator()(const FrameInstance* l, const FrameInstance* r) const noexcept;
+};
+
+// Runs the frames of a single-threaded substrate one at a time. Ready frames wait in the mailbox; whoever claims the
+// running flag gets the one with the lowest tick, or the lowest frame number for ffFrameOrdered filters, and the
+// worker finishing a frame takes the next one itself. For ffSerialRounds filters, a frame that needs another round
+// stays active, and the other frames wait until it is finished or retired.
+class SerialExecutor {
+    std::mutex mutex;
+    std::set<FrameInstance*, FrameInstanceSerialGreater> mailbox;
+    std::atomic_flag running;
+    const bool serial_rounds;
+    FrameInstance* active = nullptr;
+
+    // with the mutex held
+    bool runnable() const noexcept;
+    FrameInstance* pop() noexcept;
+
+  public:
+    SerialExecutor(bool frame_ordered, bool serial_rounds) noexcept;
+    void post(FrameInstance* inst) noexcept;
+    // removes inst unless it has been handed out
+    bool withdraw(FrameInstance* inst) noexcept;
+    // the frame to run if the caller has claimed the executor, otherwise nullptr
+    FrameInstance* claim() noexcept;
+    // Called by the claimer once its frame has finished, or been skipped if ran is nullptr: the next frame to run
+    // under the same claim, or nullptr. unfinished tells whether ran needs another round.
+    FrameInstance* finish(FrameInstance* ran = nullptr, bool unfinished = false) noexcept;
+    // Drops the frame if it is active, as it is killed between its rounds. Returns whether it was; the caller then
+    // claims the executor for the frames it held back.
+    bool retire(FrameInstance* inst) noexcept;
+};
+
 class Substrate final : public Object, virtual public ISubstrate {
   public:
     cat_ptr<IFilter> filter;
+    const size_t serial;
+
+    const size_t worker_slots;
+    std::unique_ptr<WorkerCounters[]> worker_counters;
+    // only written by the maintainer shard owning the substrate
+    std::atomic_size_t recomputes{0};
+    std::atomic_size_t bytes_produced{0};
+    std::atomic_size_t in_flight{0};
+    // moving average of process_frame time in nanoseconds, for critical path ranking
+    std::atomic_uint64_t mean_cost{0};
+    // only used for ffSingleThreaded filters
+    SerialExecutor executor;
 
     VideoInfo get_video_info() const noexcept final;
 
     Substrate(Nucleus& nucl, cat_ptr<const IFilter> filter) noexcept;
 };
 
-struct FrameInstance;
-struct FrameInstanceTickGreater {
-    bool operator()(const FrameInstance* l, const FrameInstance* r) const noexcept;
-};
-
 struct Construct {
     cat_ptr<Substrate> substrate;
     size_t frame_idx;
     cat_ptr<ICallback> callback;
+    size_t tick;
+    // 0 for requests that cannot be cancelled
+    size_t request_id = 0;
+    unsigned lane = 0;
+};
+// withdraw the callback of the request; drop the instance if nothing else needs it
+struct Cancel {
+    cat_ptr<Substrate> substrate;
+    size_t frame_idx;
+    size_t request_id;
+    // frames in [prefetch_first, prefetch_last) were prefetched by the request, those nothing else needs are dropped
+    size_t prefetch_first = 0;
+    size_t prefetch_last = 0;
+};
+// ask the shard owning the substrate to instantiate a dependency of output
+struct Link {
+    Substrate* substrate;
+    size_t frame_idx;
+    FrameInstance* output;
+    unsigned slot;
+    size_t tick;
+    bool missed;
+    // critical path cost of output
+    uint64_t rank;
+};
+// the input of output at slot is ready
+struct Feed {
+    FrameInstance* output;
+    unsigned slot;
+    FrameInstance* input;
 };
-struct Notify {
-    FrameInstance* inst;
+// the input of output at slot has failed
+struct Fail {
+    FrameInstance* output;
     std::exception_ptr exc;
 };
+// output has been cancelled and no longer waits for a slot linked to this frame; answered with Fail if still linked
+struct Unlink {
+    Substrate* substrate;
+    size_t frame_idx;
+    FrameInstance* output;
+};
 
-struct MaintainTask : std::variant<Construct, Notify> {
-    explicit MaintainTask(cat_ptr<Substrate> substrate, size_t frame_idx,
-                          cat_ptr<ICallback> callback = {}) noexcept;
-    explicit MaintainTask(FrameInstance* inst, std::exception_ptr exc = {}) noexcept;
+struct MaintainTask : std::variant<Construct, Link, Feed, Fail, Cancel, Unlink> {
+    using variant::variant;
 };
 
+// callback lane invoking the callbacks on the worker finishing the frame instead of a callback thread
+inline constexpr unsigned inline_lane = ~0u;
+
 struct CallbackTask {
-    std::function<void()> callback;
+    cat_ptr<ICallback> callback;
+    cat_ptr<const IFrame> frame;
+    std::exception_ptr exc;
+    // for tracing only
+    size_t substrate;
+    size_t frame_idx;
+    const void* inst;
+};
+
+struct PlaneKey {
+    size_t size;
+    size_t stride;
+    // NUMA node of the thread that acquired the buffer, so its pages are only recycled to threads on that node. Only
+    // recycling is node-aware: fresh buffers are not bound to a node, and land on the acquiring thread's node only when
+    // the allocator hands out pages nobody has touched yet.
+    unsigned node;
+    auto operator<=>(const PlaneKey&) const = default;
 };
 
-NucleusConfig create_config(NucleusConfig tmpl = {}) noexcept;
+// recycles plane buffers of the same geometry; threads keep a few in local magazines before touching the depot
+class PlanePool final : public Object, virtual public IRef {
+    std::mutex mutex;
+    std::map<PlaneKey, std::vector<void*>> depot;
+    // bytes of the buffers in the depot and in every thread's magazines
+    std::atomic_size_t cached_bytes{0};
+    std::atomic_size_t hits{0}, misses{0}, drops{0};
+
+  public:
+    struct Magazine;
+
+  private:
+    Magazine& local(PlaneKey key) noexcept;
+    void flush_stats(Magazine& mag) noexcept;
 
-class Nucleus final : public Object, virtual public INucleus, virtual public IFactory1 {
   public:
-    NucleusConfig config{create_config()};
+    static constexpr unsigned magazine_size = 4;
+    static constexpr unsigned magazine_count = 4;
+
+    std::atomic_size_t capacity;
+
+    explicit PlanePool(size_t capacity) noexcept;
+    ~PlanePool() final;
+
+    void* acquire(PlaneKey key) noexcept;
+    void recycle(PlaneKey key, void* buf) noexcept;
+    PlanePoolStats get_stats() noexcept;
+};
+
+enum class TraceEvent : uint8_t {
+    Construct,
+    Ready,
+    Dequeue,
+    ProcessStart,
+    ProcessEnd,
+    Callback,
+};
+
+struct TraceRecord {
+    uint64_t time;
+    size_t substrate;
+    size_t frame_idx;
+    const void* inst;
+    TraceEvent event;
+};
+
+// Each thread records into its own ring, overwriting the oldest records when full. Only the owner thread writes;
+// the exporter copies a ring and drops whatever was overwritten meanwhile.
+class Tracer {
+    struct Ring {
+        std::unique_ptr<TraceRecord[]> records;
+        std::atomic_size_t written{0};
+        std::string name;
+    };
+
+    const size_t serial;
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Ring>> rings;
+
+    Ring& local() noexcept;
+
+  public:
+    static constexpr size_t ring_size = 1 << 16;
+
+    Tracer() noexcept;
+    void name_thread(std::string name) noexcept;
+    void record(TraceEvent event, size_t substrate, size_t frame_idx, const void* inst) noexcept;
+    std::string export_json() noexcept;
+};
+
+NucleusConfig1 create_config(NucleusConfig1 tmpl = {}) noexcept;
+// Size of the buffer behind bytes, the whole parent for a view.
+size_t buffer_bytes(const IBytes* bytes) noexcept;
+// Charge a buffer to the frame cache, or release the charge. Shared buffers return their size only for the first charge
+// and the last release, however many frames or views hold them; foreign buffers are charged per holder.
+size_t charge_bytes(const IBytes* bytes) noexcept;
+size_t uncharge_bytes(const IBytes* bytes) noexcept;
+
+class Nucleus final : public Object, virtual public INucleus1, virtual public IFactory1 {
+  public:
+    // as set, with zeros for the defaults, which are resolved into config
+    NucleusConfig1 requested_config{};
+    NucleusConfig1 config{create_config()};
 
     Logger logger;
 
@@ -142,11 +340,27 @@ class Nucleus final : public Object, virtual public INucleus, virtual public IFa
 
     std::map<const IFilter*, cat_ptr<ISubstrate>> substrates;
 
-    SCQueue<MaintainTask> maintain_queue;
-    SCQueue<CallbackTask> callback_queue;
-    PriorityQueue<FrameInstance*, FrameInstanceTickGreater> work_queue;
-    std::optional<JThread> maintainer_thread;
-    std::optional<JThread> callback_thread;
+    std::atomic_size_t substrate_serial;
+    std::atomic_size_t tick;
+    std::atomic_size_t request_serial{1};
+    std::atomic_size_t output_serial;
+    std::atomic_size_t product_bytes;
+    // workers blocked on an empty work queue
+    std::atomic_uint idle_workers;
+
+    cat_ptr<PlanePool> plane_pool;
+    Tracer tracer;
+
+    // tasks posted before the reaction, handed to the maintainers once they are started
+    std::mutex early_mutex;
+    std::vector<std::pair<const Substrate*, MaintainTask>> early_tasks;
+    std::atomic_bool maintainers_ready;
+    std::unique_ptr<SCQueue<MaintainTask>[]> maintain_queues;
+    std::unique_ptr<BatchInbox<FrameInstance>[]> notify_inboxes;
+    std::unique_ptr<SCQueue<CallbackTask>[]> callback_queues;
+    StealingQueue<FrameInstance*, FrameInstancePriorityGreater> work_queue;
+    std::vector<JThread> maintainer_threads;
+    std::vector<JThread> callback_threads;
     std::vector<JThread> worker_threads;
 
     Nucleus();
@@ -168,6 +382,8 @@ class Nucleus final : public Object, virtual public INucleus, virtual public IFa
     void create_dll_enzyme_finder(const char* path, IEnzymeFinder** out) noexcept final;
     void create_catsyn_v1_ribosome(IRibosome** out) noexcept final;
     void create_pathway(IPathway** out) noexcept final;
+    void create_bytes_view(const IBytes* parent, size_t offset, size_t len, IBytes** out) noexcept final;
+    void create_plane(size_t len, size_t stride, IBytes** out) noexcept;
 
     void synthesize_enzymes() noexcept final;
     ITable* get_enzymes() noexcept final;
@@ -177,9 +393,21 @@ class Nucleus final : public Object, virtual public INucleus, virtual public IFa
 
     void set_config(NucleusConfig config) noexcept final;
     NucleusConfig get_config() const noexcept final;
+    void set_config(NucleusConfig1 config) noexcept final;
+    void get_config(NucleusConfig1* out) const noexcept final;
 
     void react() noexcept final;
     bool is_reacting() const noexcept final;
 
     void create_output(ISubstrate* substrate, IOutput** output) noexcept final;
+
+    PlanePoolStats get_plane_pool_stats() const noexcept final;
+    void export_trace(IBytes** out) noexcept final;
+    void collect_stats(IStats** out) noexcept final;
+    void run_bands(unsigned count, void (*band)(void* user_data, unsigned idx), void* user_data) final;
+    void release_input(size_t idx) noexcept final;
+
+    bool tracing() const noexcept {
+        return config.reaction_flags & rfTrace;
+    }
 };
@@ -1,5 +1,6 @@
 #include <filesystem>
 #include <map>
+#include <optional>
 #include <string_view>
 
 #include <catimpl.h>
@@ -9,8 +10,7 @@
 #define INIT_FUNC_SYMBOL "?catsyn_enzyme_init@@YAXPEAVINucleus@catsyn@@PEAPEAVIObject@2@@Z"
 #else
 #define DLL_SUFFIX ".so"
-// STUB
-#define INIT_FUNC_SYMBOL ""
+#define INIT_FUNC_SYMBOL "_Z18catsyn_enzyme_initPN6catsyn8INucleusEPPNS_7IObjectE"
 #endif
 
 class DllEnzymeFinder final : public Object, virtual public IEnzymeFinder, public Shuttle {
@@ -133,6 +133,30 @@ void Nucleus::synthesize_enzymes() noexcept {
             tokens.emplace_back(p[i]);
     }
     dedup(tokens);
+
+    // Every ribosome opens each library on its own, and drops it again if it is not the library's kind. Open the
+    // libraries up front and keep them pinned until synthesis is over, so a library is read from disk and initialized
+    // only once. The loader lock serializes opening anyway, so only the reads are spread over threads, warming the
+    // page cache for the libraries opened one after another here.
+    std::vector<std::optional<SharedLibrary>> pins(tokens.size());
+    {
+        std::atomic_size_t next{0};
+        std::vector<std::jthread> prefetchers;
+        auto prefetcher_count = std::min(size_t{std::max(config.thread_count, 1u)}, tokens.size());
+        for (size_t i = 0; i < prefetcher_count; ++i)
+            prefetchers.emplace_back([&]() {
+                for (size_t idx; (idx = next.fetch_add(1, std::memory_order_relaxed)) < tokens.size();)
+                    if (tokens[idx].starts_with("dll:"))
+                        prefetch_file(std::filesystem::path{tokens[idx].substr(4)});
+            });
+    }
+    for (size_t idx = 0; idx < tokens.size(); ++idx)
+        if (tokens[idx].starts_with("dll:"))
+            try {
+                pins[idx].emplace(std::filesystem::path{tokens[idx].substr(4)});
+            } catch (std::system_error&) {
+            }
+
     std::map<std::string_view, cat_ptr<IEnzyme>> ezs;
     for (auto token_sv : tokens) {
         // we are sure that tokens are null terminated!
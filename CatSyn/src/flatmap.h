@@ -0,0 +1,143 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include <boost/functional/hash.hpp>
+
+// Open-addressing hash map with linear probing and backward-shift deletion. Keys and values are stored inline in one
+// array, so a lookup usually touches a single cache line. K and V must be cheap to default-construct and move.
+template<typename K, typename V, typename Hash = boost::hash<K>> class FlatMap {
+    struct Slot {
+        K key{};
+        V value{};
+        bool used = false;
+    };
+
+    std::vector<Slot> slots;
+    size_t count = 0;
+    unsigned shift = 64;
+
+    size_t home(const K& key) const noexcept {
+        // Fibonacci hashing spreads poorly mixed hashes such as pointers over the whole table
+        return static_cast<size_t>((Hash{}(key) * UINT64_C(0x9E3779B97F4A7C15)) >> shift);
+    }
+
+    size_t mask() const noexcept {
+        return slots.size() - 1;
+    }
+
+    void grow() {
+        auto old = std::move(slots);
+        slots = std::vector<Slot>(old.empty() ? 16 : old.size() * 2);
+        shift = 64 - std::countr_zero(slots.size());
+        for (auto& slot : old)
+            if (slot.used)
+                place(std::move(slot.key), std::move(slot.value));
+    }
+
+    V& place(K&& key, V&& value) noexcept {
+        auto i = home(key);
+        while (slots[i].used)
+            i = (i + 1) & mask();
+        slots[i].key = std::move(key);
+        slots[i].value = std::move(value);
+        slots[i].used = true;
+        return slots[i].value;
+    }
+
+    Slot* lookup(const K& key) noexcept {
+        if (slots.empty())
+            return nullptr;
+        for (auto i = home(key);; i = (i + 1) & mask())
+            if (!slots[i].used)
+                return nullptr;
+            else if (slots[i].key == key)
+                return &slots[i];
+    }
+
+  public:
+    V* find(const K& key) noexcept {
+        auto slot = lookup(key);
+        return slot ? &slot->value : nullptr;
+    }
+
+    // returns the value and whether it was inserted
+    std::pair<V*, bool> try_emplace(K key, V value = {}) {
+        if (auto slot = lookup(key))
+            return {&slot->value, false};
+        if ((count + 1) * 4 > slots.size() * 3)
+            grow();
+        ++count;
+        return {&place(std::move(key), std::move(value)), true};
+    }
+
+    bool erase(const K& key) noexcept {
+        auto slot = lookup(key);
+        if (!slot)
+            return false;
+        auto hole = static_cast<size_t>(slot - slots.data());
+        // shift back the following entries of the cluster whose home is not between the hole and themselves
+        for (auto i = (hole + 1) & mask(); slots[i].used; i = (i + 1) & mask())
+            if (((i - home(slots[i].key)) & mask()) >= ((i - hole) & mask())) {
+                slots[hole] = std::move(slots[i]);
+                hole = i;
+            }
+        slots[hole] = Slot{};
+        --count;
+        return true;
+    }
+
+    template<typename F> void for_each(F&& f) {
+        for (auto& slot : slots)
+            if (slot.used)
+                f(slot.key, slot.value);
+    }
+
+    size_t size() const noexcept {
+        return count;
+    }
+
+    void clear() noexcept {
+        slots.clear();
+        count = 0;
+        shift = 64;
+    }
+};
+
+// Fixed-size object allocator handing out storage from chunks of N objects. Freed storage is kept on an intrusive
+// free list and reused first; chunks are only returned when the slab is destroyed, after every object is destroyed.
+template<typename T, size_t N = 64> class Slab {
+    union Storage {
+        Storage* next;
+        alignas(T) std::byte data[sizeof(T)];
+    };
+
+    std::vector<std::unique_ptr<Storage[]>> chunks;
+    Storage* free_list = nullptr;
+
+  public:
+    template<typename... Args> T* make(Args&&... args) {
+        if (!free_list) {
+            auto& chunk = chunks.emplace_back(new Storage[N]);
+            for (size_t i = 0; i < N; ++i) {
+                chunk[i].next = free_list;
+                free_list = &chunk[i];
+            }
+        }
+        auto storage = free_list;
+        free_list = storage->next;
+        return new (storage->data) T(std::forward<Args>(args)...);
+    }
+
+    void destroy(T* p) noexcept {
+        p->~T();
+        auto storage = reinterpret_cast<Storage*>(p);
+        storage->next = free_list;
+        free_list = storage;
+    }
+};
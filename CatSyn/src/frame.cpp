@@ -1,10 +1,16 @@
 #include <array>
+#include <cstring>
 
 #include <catimpl.h>
 
 #include <allostery.h>
 
-class Bytes : public Object, virtual public IBytes {
+// A buffer frames may share, directly or through views. The cache charges it once, while any cached frame holds it.
+struct Charged {
+    mutable std::atomic_size_t charges = 0;
+};
+
+class Bytes : public Object, public Charged, virtual public IBytes {
     void* buf;
     size_t len;
   public:
@@ -41,6 +47,240 @@ class Bytes : public Object, virtual public IBytes {
     }
 };
 
+class BytesView final : public Object, virtual public IBytes {
+    cat_ptr<const IBytes> parent;
+    size_t offset;
+    size_t len;
+
+    void detach(size_t new_size) noexcept {
+        cat_ptr<IBytes> owned;
+        create_instance<Bytes>(owned.put(), nullptr, new_size);
+        // views are not aligned, so round_copy must not be used here
+        memcpy(owned->data(), static_cast<const char*>(parent->data()) + offset, std::min(len, new_size));
+        parent = owned;
+        offset = 0;
+        len = new_size;
+    }
+
+  public:
+    BytesView(const IBytes* parent, size_t offset, size_t len) noexcept : parent(parent), offset(offset), len(len) {
+        if (auto view = dynamic_cast<const BytesView*>(parent)) {
+            this->parent = view->parent;
+            this->offset += view->offset;
+        }
+        cond_check(this->offset + len <= this->parent->size(), "bytes view out of range");
+    }
+
+    void clone(IObject** out) const noexcept final {
+        create_instance<BytesView>(out, parent.get(), offset, len);
+    }
+
+    void realloc(size_t new_size) noexcept final {
+        detach(new_size);
+    }
+
+    void* data() noexcept final {
+        // writing through a view must not be observed by other holders of the parent
+        auto parent_mut = parent.try_usurp();
+        if (!parent_mut) {
+            detach(len);
+            parent_mut = parent.try_usurp();
+        }
+        return static_cast<char*>(parent_mut->data()) + offset;
+    }
+
+    const void* data() const noexcept final {
+        return static_cast<const char*>(parent->data()) + offset;
+    }
+
+    size_t size() const noexcept final {
+        return len;
+    }
+
+    const IBytes* get_parent() const noexcept {
+        return parent.get();
+    }
+};
+
+static const IBytes* buffer_of(const IBytes* bytes) noexcept {
+    auto view = dynamic_cast<const BytesView*>(bytes);
+    return view ? view->get_parent() : bytes;
+}
+
+size_t buffer_bytes(const IBytes* bytes) noexcept {
+    return buffer_of(bytes)->size();
+}
+
+size_t charge_bytes(const IBytes* bytes) noexcept {
+    auto buffer = buffer_of(bytes);
+    auto charged = dynamic_cast<const Charged*>(buffer);
+    if (!charged || !charged->charges.fetch_add(1, std::memory_order_relaxed))
+        return buffer->size();
+    return 0;
+}
+
+size_t uncharge_bytes(const IBytes* bytes) noexcept {
+    auto buffer = buffer_of(bytes);
+    auto charged = dynamic_cast<const Charged*>(buffer);
+    if (!charged || charged->charges.fetch_sub(1, std::memory_order_relaxed) == 1)
+        return buffer->size();
+    return 0;
+}
+
+// A magazine holds a reference to its pool, so the buffers it keeps can always be returned to the pool's accounting,
+// even when the magazine is evicted or its thread exits after the nucleus is gone.
+struct PlanePool::Magazine {
+    cat_ptr<PlanePool> pool;
+    PlaneKey key;
+    unsigned count;
+    void* bufs[magazine_size];
+    size_t hits, misses;
+
+    void free_all() noexcept {
+        if (!count)
+            return;
+        pool->cached_bytes.fetch_sub(count * key.size, std::memory_order_relaxed);
+        while (count)
+            operator delete(bufs[--count]);
+    }
+};
+
+static thread_local struct Magazines {
+    PlanePool::Magazine mags[PlanePool::magazine_count]{};
+    unsigned victim{0};
+
+    ~Magazines() {
+        for (auto& mag : mags)
+            mag.free_all();
+    }
+} magazines;
+
+PlanePool::PlanePool(size_t capacity) noexcept : capacity(capacity) {}
+
+PlanePool::~PlanePool() {
+    for (auto& [key, bufs] : depot)
+        for (auto buf : bufs)
+            operator delete(buf);
+}
+
+PlanePool::Magazine& PlanePool::local(PlaneKey key) noexcept {
+    for (auto& mag : magazines.mags)
+        if (mag.pool.get() == this && mag.key == key)
+            return mag;
+    auto& mag = magazines.mags[magazines.victim++ % magazine_count];
+    if (mag.pool.get() == this)
+        flush_stats(mag);
+    else if (mag.pool)
+        mag.pool->flush_stats(mag);
+    if (mag.pool)
+        mag.free_all();
+    mag.pool = this;
+    mag.key = key;
+    mag.hits = mag.misses = 0;
+    return mag;
+}
+
+void PlanePool::flush_stats(Magazine& mag) noexcept {
+    hits.fetch_add(mag.hits, std::memory_order_relaxed);
+    misses.fetch_add(mag.misses, std::memory_order_relaxed);
+    mag.hits = mag.misses = 0;
+}
+
+void* PlanePool::acquire(PlaneKey key) noexcept {
+    auto& mag = local(key);
+    if (!mag.count) {
+        flush_stats(mag);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (auto it = depot.find(key); it != depot.end())
+            for (auto& bufs = it->second; !bufs.empty() && mag.count < magazine_size; bufs.pop_back())
+                mag.bufs[mag.count++] = bufs.back();
+    }
+    if (mag.count) {
+        ++mag.hits;
+        cached_bytes.fetch_sub(key.size, std::memory_order_relaxed);
+        return mag.bufs[--mag.count];
+    } else {
+        ++mag.misses;
+        return operator new(key.size);
+    }
+}
+
+// Buffers in the magazines count against the capacity like those in the depot, so a buffer that would exceed it is
+// freed right away. Moving buffers between a magazine and the depot leaves the count unchanged.
+void PlanePool::recycle(PlaneKey key, void* buf) noexcept {
+    auto& mag = local(key);
+    auto cap = capacity.load(std::memory_order_relaxed);
+    if (mag.count == magazine_size) {
+        flush_stats(mag);
+        std::lock_guard<std::mutex> lock(mutex);
+        auto& bufs = depot[key];
+        for (; mag.count; --mag.count) {
+            auto p = mag.bufs[mag.count - 1];
+            // the capacity may have shrunk since the buffers were cached
+            if (cached_bytes.load(std::memory_order_relaxed) <= cap)
+                bufs.push_back(p);
+            else {
+                operator delete(p);
+                cached_bytes.fetch_sub(key.size, std::memory_order_relaxed);
+                drops.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+    if (cached_bytes.fetch_add(key.size, std::memory_order_relaxed) + key.size > cap) {
+        cached_bytes.fetch_sub(key.size, std::memory_order_relaxed);
+        operator delete(buf);
+        drops.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    mag.bufs[mag.count++] = buf;
+}
+
+PlanePoolStats PlanePool::get_stats() noexcept {
+    for (auto& mag : magazines.mags)
+        if (mag.pool.get() == this)
+            flush_stats(mag);
+    return {hits.load(std::memory_order_relaxed), misses.load(std::memory_order_relaxed),
+            drops.load(std::memory_order_relaxed), cached_bytes.load(std::memory_order_relaxed)};
+}
+
+class PlaneBytes final : public Object, public Charged, virtual public IBytes {
+    cat_ptr<PlanePool> pool;
+    PlaneKey key;
+    void* buf;
+
+  public:
+    PlaneBytes(PlanePool* pool, PlaneKey key, const void* data) noexcept
+        : pool(pool), key(key), buf(pool->acquire(key)) {
+        if (data)
+            round_copy(buf, data, key.size);
+    }
+
+    ~PlaneBytes() override {
+        pool->recycle(key, buf);
+    }
+
+    void clone(IObject** out) const noexcept final {
+        create_instance<PlaneBytes>(out, pool.get(), PlaneKey{key.size, key.stride, get_current_numa_node()}, buf);
+    }
+
+    void realloc(size_t new_size) noexcept final {
+        buf = re_alloc(buf, new_size);
+        key.size = new_size;
+    }
+
+    void* data() noexcept final {
+        return buf;
+    }
+
+    const void* data() const noexcept final {
+        return buf;
+    }
+
+    size_t size() const noexcept final {
+        return key.size;
+    }
+};
+
 class Numeric : public Bytes, virtual public INumeric {
   public:
     Numeric(SampleType sample_type, const void* data, size_t bytes_count) noexcept : Bytes(data, bytes_count) {
@@ -52,6 +292,18 @@ void Nucleus::create_bytes(const void* data, size_t len, IBytes** out) noexcept
     create_instance<Bytes>(out, data, len);
 }
 
+void Nucleus::create_bytes_view(const IBytes* parent, size_t offset, size_t len, IBytes** out) noexcept {
+    create_instance<BytesView>(out, parent, offset, len);
+}
+
+void Nucleus::create_plane(size_t len, size_t stride, IBytes** out) noexcept {
+    create_instance<PlaneBytes>(out, plane_pool.get(), PlaneKey{len, stride, get_current_numa_node()}, nullptr);
+}
+
+PlanePoolStats Nucleus::get_plane_pool_stats() const noexcept {
+    return plane_pool->get_stats();
+}
+
 void Nucleus::create_numeric(SampleType sample_type, const void* data, size_t bytes_count, INumeric** out) noexcept {
     create_instance<Numeric>(out, sample_type, data, bytes_count);
 }
@@ -122,7 +374,7 @@ class Frame final : public Object, virtual public IFrame, public Shuttle {
             } else {
                 auto stride = default_stride(fi, idx);
                 size_t len = stride * fi.height;
-                nucl.create_bytes(nullptr, len, planes[idx].put());
+                nucl.create_plane(len, stride, planes[idx].put());
                 strides[idx] = stride;
             }
         }
@@ -19,35 +19,43 @@ static void log_out(LogLevel level, const char* msg) noexcept {
     format_to_err("{} {}\n", prompt, msg);
 }
 
-static void log_worker(SCQueue<uintptr_t>& queue, ILogSink* const& sink) {
-    queue.stream([&](uintptr_t record) {
-        auto level = static_cast<LogLevel>((record & 3u) * 10u);
-        auto msg = reinterpret_cast<char*>(record & ~static_cast<uintptr_t>(3));
+static void log_worker(ByteRing& ring, ILogSink* const& sink) {
+    set_thread_priority(-1, false);
+    auto send = [&](LogLevel level, const char* msg) {
         if (sink)
             sink->send_log(level, msg);
         else
             log_out(level, msg);
-        operator delete(msg);
-    });
+    };
+    auto report_dropped = [&]() {
+        if (auto dropped = ring.take_dropped()) [[unlikely]]
+            send(LogLevel::WARNING, format_c("Logger: {} messages dropped", dropped));
+    };
+    ring.stream([&](unsigned tag, const std::byte* data, size_t) {
+        send(static_cast<LogLevel>(tag), reinterpret_cast<const char*>(data));
+        report_dropped();
+    }, report_dropped);
 }
 
 Logger::Logger()
-    : filter_level(LogLevel::DEBUG),
-      thread(log_worker, std::ref(queue), std::cref(*sink.addressof())) {
-    set_thread_priority(thread, -1, false);
-}
+    : ring(64 << 10), filter_level(LogLevel::DEBUG),
+      thread(log_worker, std::ref(ring), std::cref(*sink.addressof())) {}
 
 Logger::~Logger() {
-    queue.request_stop();
+    ring.request_stop();
 }
 
+// Messages are copied into the ring in place. When it is full, the message is dropped and counted; DEBUG messages
+// may only fill half of it, so a flood of them leaves room for the more severe ones.
 void Logger::log(LogLevel level, const char* msg) const noexcept {
     if (level < filter_level)
         return;
-    auto msg_len = std::strlen(msg);
-    auto copied = static_cast<char*>(operator new(msg_len + 1));
-    std::memcpy(copied, msg, msg_len + 1);
-    queue.push(reinterpret_cast<uintptr_t>(copied) | static_cast<uintptr_t>(level) / 10);
+    auto len = strnlen(msg, max_message);
+    auto limit = level == LogLevel::DEBUG ? ring.capacity() / 2 : ring.capacity();
+    ring.push(static_cast<unsigned>(level), len + 1, limit, [&](std::byte* dst) {
+        std::memcpy(dst, msg, len);
+        dst[len] = std::byte{0};
+    });
 }
 
 void Logger::set_level(LogLevel level) noexcept {
@@ -1,11 +1,20 @@
 #include <catimpl.h>
 
-NucleusConfig create_config(NucleusConfig tmpl) noexcept {
+NucleusConfig1 create_config(NucleusConfig1 tmpl) noexcept {
     tmpl.thread_count = tmpl.thread_count ? tmpl.thread_count : std::thread::hardware_concurrency();
     tmpl.mem_hint_mb = tmpl.mem_hint_mb ? tmpl.mem_hint_mb : 4096;
+    tmpl.maintainer_count =
+        tmpl.maintainer_count ? tmpl.maintainer_count : std::max((tmpl.thread_count + 15) / 16, 1u);
+    // callback threads mostly wait on consumers, so one slow output should not hold up the others
+    tmpl.callback_count = tmpl.callback_count ? tmpl.callback_count : std::max(tmpl.thread_count / 4, 2u);
     return tmpl;
 }
 
+// recycled planes are kept on top of the frame cache, so only let them take a fraction of the budget
+static size_t plane_pool_capacity(const NucleusConfig1& config) noexcept {
+    return static_cast<size_t>(config.mem_hint_mb) << 20 >> 3;
+}
+
 Shuttle::Shuttle(Nucleus& nucl) noexcept : nucl(nucl) {}
 
 Nucleus::Nucleus() {
@@ -22,6 +31,8 @@ Nucleus::Nucleus() {
 
     create_table(0, t.put());
     enzymes = t.query<Table>();
+
+    create_instance<PlanePool>(plane_pool.put(), plane_pool_capacity(config));
 }
 
 IFactory* Nucleus::get_factory() noexcept {
@@ -44,13 +55,27 @@ ITable* Nucleus::get_enzymes() noexcept {
     return enzymes.get();
 }
 
-void Nucleus::set_config(NucleusConfig cfg) noexcept {
+void Nucleus::set_config(NucleusConfig1 cfg) noexcept {
     cond_check(!is_reacting(), "changing config is not allowed during reaction");
+    requested_config = cfg;
     config = create_config(cfg);
+    plane_pool->capacity.store(plane_pool_capacity(config), std::memory_order_relaxed);
+}
+
+void Nucleus::get_config(NucleusConfig1* out) const noexcept {
+    *out = config;
+}
+
+// the knobs of NucleusConfig1 keep their setting, defaults derived from the thread count included
+void Nucleus::set_config(NucleusConfig cfg) noexcept {
+    auto cfg1 = requested_config;
+    cfg1.thread_count = cfg.thread_count;
+    cfg1.mem_hint_mb = cfg.mem_hint_mb;
+    set_config(cfg1);
 }
 
 NucleusConfig Nucleus::get_config() const noexcept {
-    return config;
+    return {config.thread_count, config.mem_hint_mb};
 }
 
 CAT_API Version catsyn::get_version() noexcept {
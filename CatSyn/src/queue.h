@@ -1,7 +1,12 @@
 #pragma once
 
+#include <algorithm>
 #include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
 #include <exception>
+#include <memory>
 #include <queue>
 
 inline void yield() noexcept {
@@ -25,6 +30,7 @@ template<typename T> class SCQueue {
     std::atomic<Node*> head;
     std::atomic<Node*> tail;
     std::atomic_flag sem;
+    std::atomic_flag stopped;
 
     template<bool notify = true> void push(Node* new_node) noexcept {
         auto prev = head.exchange(new_node, std::memory_order_acq_rel);
@@ -76,9 +82,29 @@ template<typename T> class SCQueue {
     }
 
     void request_stop() noexcept {
+        stopped.test_and_set(std::memory_order_release);
         push<true>(new Node{std::nullopt});
     }
 
+    // wakes the consumer blocked in wait() without pushing anything
+    void wake() noexcept {
+        sem.clear(std::memory_order_release);
+        sem.notify_one();
+    }
+
+    // blocks until something is pushed or wake() is called; may return spuriously
+    void wait() {
+        if (tail.load(std::memory_order_relaxed)->next.load(std::memory_order_acquire))
+            return;
+        for (;;) {
+            if (stopped.test(std::memory_order_acquire)) [[unlikely]]
+                throw StopRequested();
+            if (!sem.test_and_set(std::memory_order_acquire))
+                return;
+            sem.wait(true, std::memory_order_relaxed);
+        }
+    }
+
     template<bool wait = true, typename F> void consume_one(F&& f) noexcept(!wait) {
         auto v = pop<wait>();
         if constexpr (wait)
@@ -211,6 +237,289 @@ template<typename T, typename Compare = std::less<>> class PriorityQueue {
     }
 };
 
+// One lane per consumer. A consumer pushes to and pops from its own lane and only steals from the others once its
+// lane is empty; other threads spread their pushes over the lanes. Producers only touch the shared wake-up flag when
+// a consumer is about to sleep.
+template<typename T, typename Compare = std::less<>> class StealingQueue {
+    // a priority queue whose entries can be erased from the middle
+    struct Heap : std::priority_queue<T, std::vector<T>, Compare> {
+        template<typename P> size_t erase_if(P&& pred) noexcept {
+            auto erased = std::erase_if(this->c, std::forward<P>(pred));
+            if (erased)
+                std::make_heap(this->c.begin(), this->c.end(), this->comp);
+            return erased;
+        }
+    };
+
+    struct alignas(64) Lane {
+        Heap pq;
+        std::atomic_size_t size;
+        SpinLock lock;
+    };
+
+    static constexpr size_t no_lane = static_cast<size_t>(-1);
+    // the lane of the consumer running on this thread
+    static inline thread_local size_t home = no_lane;
+    // where this thread, if not a consumer, pushes next
+    static inline thread_local size_t cursor = 0;
+
+    std::unique_ptr<Lane[]> lanes;
+    size_t lane_count = 0;
+    alignas(64) std::atomic_uint sleepers;
+    std::atomic_flag sem;
+    std::atomic_flag stopped;
+
+    bool any() const noexcept {
+        for (size_t i = 0; i < lane_count; ++i)
+            if (lanes[i].size.load(std::memory_order_relaxed))
+                return true;
+        return false;
+    }
+
+    bool try_pop(size_t lane, T& v) noexcept {
+        auto& l = lanes[lane];
+        if (!l.size.load(std::memory_order_relaxed))
+            return false;
+        l.lock.acquire();
+        if (l.pq.empty()) {
+            l.lock.release();
+            return false;
+        }
+        v = std::move(l.pq.top());
+        l.pq.pop();
+        l.size.store(l.pq.size(), std::memory_order_relaxed);
+        l.lock.release();
+        return true;
+    }
+
+  public:
+    StealingQueue() noexcept {
+        resize(1);
+    }
+
+    // not thread safe; must be called before any consumer starts
+    void resize(size_t count) noexcept {
+        lanes.reset(new Lane[count]);
+        lane_count = count;
+    }
+
+    size_t size() const noexcept {
+        return lane_count;
+    }
+
+    template<bool notify = true> void push(T v, size_t lane) noexcept {
+        auto& l = lanes[lane];
+        l.lock.acquire();
+        l.pq.push(std::move(v));
+        l.size.store(l.pq.size(), std::memory_order_relaxed);
+        l.lock.release();
+        if constexpr (notify) {
+            // pairs with the fence of a consumer going to sleep: either it sees the entry or we see it sleeping
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (sleepers.load(std::memory_order_relaxed)) {
+                sem.clear(std::memory_order_release);
+                sem.notify_one();
+            }
+        }
+    }
+
+    template<bool notify = true> void push(T v) noexcept {
+        push<notify>(std::move(v), home != no_lane && home < lane_count ? home : cursor++ % lane_count);
+    }
+
+    template<bool wait = true> std::conditional_t<wait, T, std::optional<T>> pop(size_t lane) noexcept(!wait) {
+        T v;
+        for (;;) {
+            for (size_t i = 0; i < lane_count; ++i)
+                if (try_pop((lane + i) % lane_count, v))
+                    return v;
+            if constexpr (wait) {
+                if (stopped.test(std::memory_order_acquire)) [[unlikely]]
+                    throw StopRequested();
+                sem.test_and_set(std::memory_order_relaxed);
+                sleepers.fetch_add(1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (!any() && !stopped.test(std::memory_order_acquire))
+                    sem.wait(true, std::memory_order_acquire);
+                sleepers.fetch_sub(1, std::memory_order_relaxed);
+            } else
+                return std::nullopt;
+        }
+    }
+
+    // pops the top of the first lane, starting at lane, whose top satisfies pred
+    template<typename P> std::optional<T> pop_if(size_t lane, P&& pred) noexcept {
+        for (size_t i = 0; i < lane_count; ++i) {
+            auto& l = lanes[(lane + i) % lane_count];
+            if (!l.size.load(std::memory_order_relaxed))
+                continue;
+            l.lock.acquire();
+            if (!l.pq.empty() && pred(l.pq.top())) {
+                T v = std::move(l.pq.top());
+                l.pq.pop();
+                l.size.store(l.pq.size(), std::memory_order_relaxed);
+                l.lock.release();
+                return v;
+            }
+            l.lock.release();
+        }
+        return std::nullopt;
+    }
+
+    // erases the entries satisfying pred from the lane of the consumer running on this thread, returning how many
+    template<typename P> size_t erase_if(P&& pred) noexcept {
+        if (home == no_lane || home >= lane_count)
+            return 0;
+        auto& l = lanes[home];
+        if (!l.size.load(std::memory_order_relaxed))
+            return 0;
+        l.lock.acquire();
+        auto erased = l.pq.erase_if(std::forward<P>(pred));
+        l.size.store(l.pq.size(), std::memory_order_relaxed);
+        l.lock.release();
+        return erased;
+    }
+
+    void request_stop() noexcept {
+        stopped.test_and_set(std::memory_order_release);
+        sem.clear(std::memory_order_release);
+        sem.notify_all();
+    }
+
+    template<typename F> void stream(size_t lane, F&& f) {
+        home = lane;
+        while (true) {
+            f(pop<true>(lane));
+        }
+    }
+
+    // like stream, but calls idle before blocking on an empty queue
+    template<typename F, typename G> void stream(size_t lane, F&& f, G&& idle) {
+        home = lane;
+        while (true) {
+            if (auto v = pop<false>(lane); v)
+                f(std::move(v.value()));
+            else {
+                idle();
+                f(pop<true>(lane));
+            }
+        }
+    }
+};
+
+// Intrusive multi-producer stack of batches. T links through its batch_next member, so publishing needs no
+// allocation; the consumer takes everything at once.
+template<typename T> class alignas(64) BatchInbox {
+    std::atomic<T*> head{nullptr};
+
+  public:
+    // returns whether the inbox was empty, i.e. whether the consumer may need a wake-up
+    bool publish(T* first, T* last) noexcept {
+        auto old = head.load(std::memory_order_relaxed);
+        do
+            last->batch_next = old;
+        while (!head.compare_exchange_weak(old, first, std::memory_order_release, std::memory_order_relaxed));
+        return !old;
+    }
+
+    T* take() noexcept {
+        return head.exchange(nullptr, std::memory_order_acquire);
+    }
+};
+
+// Multi-producer single-consumer ring of variable-length records written in place. A producer reserves whole words
+// by advancing the write cursor and publishes the record by storing its header last; records never wrap, the tail
+// of the ring is skipped with a padding record instead. A record that does not fit is dropped and counted rather
+// than blocking the producer, so pushing never allocates or waits.
+class ByteRing {
+    static constexpr unsigned pad_tag = 0x7FFFFFFF;
+
+    std::unique_ptr<uint64_t[]> words;
+    size_t mask;
+    alignas(64) std::atomic_size_t reserved{0};
+    alignas(64) std::atomic_size_t consumed{0};
+    std::atomic_size_t dropped{0};
+    std::atomic_flag sem;
+    std::atomic_flag stopped;
+
+    // header: payload bytes in the high half, then the tag, and the lowest bit set so that it is never zero
+    void commit(size_t pos, unsigned tag, size_t len) noexcept {
+        std::atomic_ref(words[pos & mask]).store(uint64_t{len} << 32 | tag << 1 | 1, std::memory_order_release);
+    }
+
+  public:
+    // capacity is in bytes and rounded up to a power of two
+    explicit ByteRing(size_t capacity) noexcept
+        : words(new uint64_t[std::bit_ceil((capacity + 7) / 8)]()), mask(std::bit_ceil((capacity + 7) / 8) - 1) {}
+
+    size_t capacity() const noexcept {
+        return (mask + 1) * 8;
+    }
+
+    // Writes a record of len bytes through write(std::byte*) unless that would fill the ring beyond limit bytes, not
+    // counting the padding skipped to wrap around, which only has to fit the ring. Tags up to 2^31 - 2 are passed
+    // through to the consumer.
+    template<typename W> bool push(unsigned tag, size_t len, size_t limit, W&& write) noexcept {
+        auto need = 1 + (len + 7) / 8;
+        auto pos = reserved.load(std::memory_order_relaxed);
+        size_t pad;
+        do {
+            pad = (pos & mask) + need > mask + 1 ? mask + 1 - (pos & mask) : 0;
+            // acquire: the consumer has cleared the words it released; if it is already past pos, the cas fails
+            auto head = consumed.load(std::memory_order_acquire);
+            if (head <= pos && ((pos + need - head) * 8 > limit || pos + pad + need - head > mask + 1)) {
+                // the first drop wakes the consumer, so the count is reported once the ring drains
+                if (!dropped.fetch_add(1, std::memory_order_relaxed)) {
+                    sem.clear(std::memory_order_release);
+                    sem.notify_one();
+                }
+                return false;
+            }
+        } while (!reserved.compare_exchange_weak(pos, pos + pad + need, std::memory_order_relaxed));
+        if (pad)
+            commit(pos, pad_tag, (pad - 1) * 8);
+        write(reinterpret_cast<std::byte*>(&words[((pos + pad) & mask) + 1]));
+        commit(pos + pad, tag, len);
+        sem.clear(std::memory_order_release);
+        sem.notify_one();
+        return true;
+    }
+
+    // records dropped since the last call
+    size_t take_dropped() noexcept {
+        return dropped.exchange(0, std::memory_order_relaxed);
+    }
+
+    void request_stop() noexcept {
+        stopped.test_and_set(std::memory_order_release);
+        sem.clear(std::memory_order_release);
+        sem.notify_one();
+    }
+
+    // Calls f(tag, data, len) for every record in order, and idle() whenever the ring is drained. Once stop is
+    // requested, returns by throwing StopRequested as soon as the ring is drained.
+    template<typename F, typename G> void stream(F&& f, G&& idle) {
+        for (auto pos = consumed.load(std::memory_order_relaxed);;) {
+            auto header = std::atomic_ref(words[pos & mask]).load(std::memory_order_acquire);
+            if (!header) {
+                idle();
+                if (stopped.test(std::memory_order_acquire)) [[unlikely]]
+                    throw StopRequested();
+                if (sem.test_and_set(std::memory_order_acquire))
+                    sem.wait(true, std::memory_order_relaxed);
+                continue;
+            }
+            auto tag = static_cast<unsigned>(header >> 1) & pad_tag;
+            auto len = static_cast<size_t>(header >> 32);
+            auto need = 1 + (len + 7) / 8;
+            if (tag != pad_tag)
+                f(tag, reinterpret_cast<const std::byte*>(&words[(pos & mask) + 1]), len);
+            std::fill_n(&words[pos & mask], need, 0);
+            consumed.store(pos += need, std::memory_order_release);
+        }
+    }
+};
+
 class Wedge {
     static constexpr unsigned highest = 1 << (sizeof(unsigned) * 8 - 1);
     std::atomic_uint* atm;
@@ -1,30 +1,192 @@
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <deque>
 #include <set>
-#include <unordered_map>
-#include <unordered_set>
+#include <stdexcept>
 
 #include <boost/container/flat_set.hpp>
 #include <boost/functional/hash.hpp>
 
 #include <catimpl.h>
+#include <flatmap.h>
+
+struct BandJob;
+
+struct Delivery {
+    size_t request_id;
+    cat_ptr<ICallback> callback;
+    unsigned lane;
+};
 
 struct FrameInstance {
     const cat_ptr<Substrate> substrate;
+    const size_t frame_idx;
     cat_ptr<const IFrame> product;
     boost::container::small_vector<FrameInstance*, 10> inputs;
-    boost::container::small_vector<FrameInstance*, 30> outputs;
-    cat_ptr<ICallback> callback;
+    boost::container::small_vector<std::pair<FrameInstance*, unsigned>, 30> outputs;
+    // callbacks of the requests waiting for the product, by request id
+    boost::container::small_vector<Delivery, 1> callbacks;
+    // inline-lane callbacks, run by the worker finishing the frame; guarded by inline_lock
+    boost::container::small_vector<Delivery, 1> inline_callbacks;
+    SpinLock inline_lock;
+    // set once inline_callbacks have been taken; those requested later go to callbacks
+    bool inline_closed;
     FrameData* frame_data;
     size_t tick;
+    // estimated nanoseconds from the start of this frame to the end of the most expensive chain of outputs depending on
+    // it, i.e. the HEFT upward rank
+    uint64_t rank;
+    // work queue order, smallest first: the tick, or the inverted rank with rfCriticalPath
+    uint64_t priority;
+    // linked outputs that may still read the product; decremented by the shards owning them
+    std::atomic_size_t consumers;
+    // input slots that have not been fed yet
+    unsigned waiting;
     std::atomic_flag taken;
+    // set by the maintainer when no request needs the frame any more; the worker then skips it
+    std::atomic_flag cancelled;
+    bool skipped;
+    bool done;
+    bool dead;
     bool false_dep;
     bool single_threaded;
-    unsigned indulgence;
+    bool cached;
+    unsigned hits;
+    // nanoseconds spent in process_frame
+    uint64_t cost;
+    // bytes of the planes held by product
+    size_t bytes;
+    std::chrono::steady_clock::time_point ready_time;
+    double cache_priority;
+    // intrusive link of the completion batch a worker hands to the maintainer, and the failure if any
+    FrameInstance* batch_next;
+    std::exception_ptr exc;
+    // bands of the frame being processed that idle workers may help with
+    std::atomic<BandJob*> band_job;
+
+    FrameInstance(Substrate* substrate, size_t frame_idx, FrameData* frame_data, size_t tick) noexcept
+        : substrate(substrate), frame_idx(frame_idx), inline_closed(false), frame_data(frame_data), tick(tick), rank(0),
+          priority(0), consumers(0), waiting(0), skipped(false), done(false), dead(false), false_dep(false),
+          single_threaded(false), cached(false), hits(1), cost(0), bytes(0), cache_priority(0), batch_next(nullptr),
+          band_job(nullptr) {}
+};
+
+// hands an inline-lane callback to the worker that will finish the frame, unless it has already taken them
+static bool adopt_inline(FrameInstance* inst, Delivery& delivery) noexcept {
+    inst->inline_lock.acquire();
+    auto adopted = !inst->inline_closed;
+    if (adopted)
+        inst->inline_callbacks.push_back(std::move(delivery));
+    inst->inline_lock.release();
+    return adopted;
+}
 
-    FrameInstance(Substrate* substrate, FrameData* frame_data, size_t tick) noexcept
-        : substrate(substrate), frame_data(frame_data), tick(tick), false_dep(false), single_threaded(false),
-          indulgence(0) {}
+static boost::container::small_vector<Delivery, 1> close_inline(FrameInstance* inst) noexcept {
+    inst->inline_lock.acquire();
+    inst->inline_closed = true;
+    auto deliveries = std::move(inst->inline_callbacks);
+    inst->inline_lock.release();
+    return deliveries;
+}
+
+static void run_callback(Nucleus& nucl, CallbackTask&& task) noexcept;
+
+struct BandJob {
+    void (*band)(void*, unsigned);
+    void* user_data;
+    const unsigned count;
+    std::atomic_uint next{0};
+    // queue entries inviting workers to help that have not been returned; the caller waits for them
+    std::atomic_uint holders{0};
+    std::atomic_flag failed;
+    std::exception_ptr exc;
+
+    BandJob(void (*band)(void*, unsigned), void* user_data, unsigned count) noexcept
+        : band(band), user_data(user_data), count(count) {}
+
+    void run() noexcept {
+        for (unsigned idx; (idx = next.fetch_add(1, std::memory_order_relaxed)) < count;)
+            try {
+                band(user_data, idx);
+            } catch (...) {
+                if (!failed.test_and_set(std::memory_order_relaxed))
+                    exc = std::current_exception();
+            }
+    }
 };
 
+// the instance whose process_frame is running on this thread, if any
+static thread_local FrameInstance* current_instance = nullptr;
+// whether it is processed as part of a batch
+static thread_local bool current_batched = false;
+
+// work queue priority reserved for band tickets, so they are always on the top of the lane they are pushed to
+static constexpr uint64_t ticket_priority = 0;
+
+// helps with the bands left of the job a ticket invites to, then returns the ticket
+static void redeem_ticket(FrameInstance* inst) noexcept {
+    if (auto job = inst->band_job.load(std::memory_order_acquire)) {
+        job->run();
+        // The job is on the stack of the caller, which stays mapped once the caller has returned, so a late
+        // notification can at most wake an unrelated waiter spuriously.
+        if (job->holders.fetch_sub(1, std::memory_order_release) == 1)
+            job->holders.notify_one();
+    }
+}
+
+// Idle workers are invited through tickets: extra work queue entries of the instance being processed, which a worker
+// recognises as such because the instance is already taken. Tickets are pushed to the lane of the calling worker, so
+// they are stolen by idle workers only. Before returning, the caller takes back from its lane the tickets nobody has
+// picked up, so no worker can reach the instance after it has been published, and sleeps until the helpers have
+// finished.
+void Nucleus::run_bands(unsigned count, void (*band)(void* user_data, unsigned idx), void* user_data) {
+    BandJob job(band, user_data, count);
+    auto inst = current_instance;
+    // nested calls run serially
+    auto helpers = inst && count > 1 && !inst->band_job.load(std::memory_order_relaxed)
+                       ? std::min(count - 1, idle_workers.load(std::memory_order_relaxed))
+                       : 0;
+    if (!helpers) {
+        job.run();
+        if (job.exc)
+            std::rethrow_exception(job.exc);
+        return;
+    }
+    // the instance is taken, so it is in no lane and its priority can be lent to the tickets
+    auto priority = std::exchange(inst->priority, ticket_priority);
+    job.holders.store(helpers, std::memory_order_relaxed);
+    inst->band_job.store(&job, std::memory_order_release);
+    for (unsigned i = 0; i < helpers; ++i)
+        work_queue.push(inst);
+    job.run();
+    // Every band has been claimed. The instance is in no lane but as a ticket, and other callers sharing the lane
+    // are left their own tickets.
+    auto reclaimed = work_queue.erase_if([=](FrameInstance* other) { return other == inst; });
+    job.holders.fetch_sub(static_cast<unsigned>(reclaimed), std::memory_order_relaxed);
+    for (unsigned left; (left = job.holders.load(std::memory_order_acquire));)
+        job.holders.wait(left, std::memory_order_acquire);
+    inst->band_job.store(nullptr, std::memory_order_relaxed);
+    inst->priority = priority;
+    if (job.exc)
+        std::rethrow_exception(job.exc);
+}
+
+// The input slot is cleared so that neither the maintainer nor a later round touches the input again; its consumer
+// count then lets the maintainer cache and evict it as usual.
+void Nucleus::release_input(size_t idx) noexcept {
+    auto inst = current_instance;
+    if (!inst || current_batched || idx >= inst->inputs.size())
+        return;
+    if (auto input = std::exchange(inst->inputs[idx], nullptr))
+        input->consumers.fetch_sub(1, std::memory_order_release);
+}
+
+static void trace(Nucleus& nucl, TraceEvent event, const FrameInstance* inst) noexcept {
+    if (nucl.tracing()) [[unlikely]]
+        nucl.tracer.record(event, inst->substrate->serial, inst->frame_idx, inst);
+}
+
 bool FrameInstanceTickGreater::operator()(const FrameInstance* l, const FrameInstance* r) const noexcept {
     if (auto cmp = l->tick <=> r->tick; cmp == 0)
         return l > r;
@@ -32,7 +194,91 @@ bool FrameInstanceTickGreater::operator()(const FrameInstance* l, const FrameIns
         return cmp > 0;
 }
 
-Substrate::Substrate(Nucleus& nucl, cat_ptr<const IFilter> filter) noexcept {
+bool FrameInstancePriorityGreater::operator()(const FrameInstance* l, const FrameInstance* r) const noexcept {
+    if (auto cmp = l->priority <=> r->priority; cmp == 0)
+        return FrameInstanceTickGreater{}(l, r);
+    else
+        return cmp > 0;
+}
+
+bool FrameInstanceSerialGreater::operator()(const FrameInstance* l, const FrameInstance* r) const noexcept {
+    if (frame_ordered && l->frame_idx != r->frame_idx)
+        return l->frame_idx > r->frame_idx;
+    else
+        return FrameInstanceTickGreater{}(l, r);
+}
+
+SerialExecutor::SerialExecutor(bool frame_ordered, bool serial_rounds) noexcept
+    : mailbox(FrameInstanceSerialGreater{frame_ordered}), serial_rounds(serial_rounds) {}
+
+bool SerialExecutor::runnable() const noexcept {
+    return active ? mailbox.contains(active) : !mailbox.empty();
+}
+
+FrameInstance* SerialExecutor::pop() noexcept {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!runnable())
+        return nullptr;
+    if (active) {
+        mailbox.erase(active);
+        return active;
+    }
+    auto top = mailbox.end();
+    auto inst = *--top;
+    mailbox.erase(top);
+    return inst;
+}
+
+void SerialExecutor::post(FrameInstance* inst) noexcept {
+    std::lock_guard<std::mutex> lock(mutex);
+    mailbox.insert(inst);
+}
+
+bool SerialExecutor::withdraw(FrameInstance* inst) noexcept {
+    std::lock_guard<std::mutex> lock(mutex);
+    return mailbox.erase(inst);
+}
+
+FrameInstance* SerialExecutor::claim() noexcept {
+    while (!running.test_and_set(std::memory_order_acquire)) {
+        if (auto inst = pop())
+            return inst;
+        running.clear(std::memory_order_release);
+        // a frame posted before the flag was cleared would otherwise be left behind
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!runnable())
+            break;
+    }
+    return nullptr;
+}
+
+FrameInstance* SerialExecutor::finish(FrameInstance* ran, bool unfinished) noexcept {
+    if (serial_rounds && ran) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (unfinished)
+            active = ran;
+        else if (active == ran)
+            active = nullptr;
+    }
+    if (auto inst = pop())
+        return inst;
+    running.clear(std::memory_order_release);
+    return claim();
+}
+
+bool SerialExecutor::retire(FrameInstance* inst) noexcept {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (active != inst)
+        return false;
+    active = nullptr;
+    return true;
+}
+
+Substrate::Substrate(Nucleus& nucl, cat_ptr<const IFilter> filter) noexcept
+    : serial(nucl.substrate_serial.fetch_add(1, std::memory_order_relaxed)),
+      worker_slots(std::max(nucl.config.thread_count, 1u)), worker_counters(new WorkerCounters[worker_slots]),
+      executor(static_cast<unsigned>(filter->get_filter_flags()) & ffFrameOrdered,
+               static_cast<unsigned>(filter->get_filter_flags()) & ffSerialRounds) {
     this->filter = filter.usurp_or_clone();
 }
 
@@ -51,48 +297,177 @@ void Nucleus::unregister_filter(const IFilter* filter) noexcept {
     substrates.erase(filter);
 }
 
-MaintainTask::MaintainTask(cat_ptr<Substrate> substrate, size_t frame_idx, cat_ptr<ICallback> callback) noexcept
-    : variant(Construct{std::move(substrate), frame_idx, std::move(callback)}) {}
-MaintainTask::MaintainTask(FrameInstance* inst, std::exception_ptr exc) noexcept : variant(Notify{inst, exc}) {}
+static void worker(Nucleus&, size_t, int);
+static void maintainer(Nucleus&, size_t);
+static void callbacker(Nucleus&, size_t);
 
-static void worker(Nucleus&);
-static void maintainer(Nucleus&);
-static void callbacker(Nucleus&);
+// CPUs for the workers in the order they are handed out: amPack fills up one NUMA node before the next, amSpread
+// alternates between nodes
+static std::vector<unsigned> worker_cpus(AffinityMode mode) noexcept {
+    std::vector<unsigned> cpus;
+    if (mode == amNone)
+        return cpus;
+    std::map<unsigned, std::vector<unsigned>> nodes;
+    for (auto [cpu, node] : get_cpu_topology())
+        nodes[node].push_back(cpu);
+    if (mode == amPack)
+        for (auto& [node, node_cpus] : nodes)
+            cpus.insert(cpus.end(), node_cpus.begin(), node_cpus.end());
+    else
+        for (size_t i = 0, added = 1; added; ++i) {
+            added = 0;
+            for (auto& [node, node_cpus] : nodes)
+                if (i < node_cpus.size()) {
+                    cpus.push_back(node_cpus[i]);
+                    ++added;
+                }
+        }
+    return cpus;
+}
+
+static size_t shard_of(Nucleus& nucl, const Substrate* substrate) noexcept {
+    return substrate->serial % nucl.config.maintainer_count;
+}
 
 void Nucleus::react() noexcept {
-    if (maintainer_thread)
+    if (!maintainer_threads.empty())
         return;
-    maintainer_thread = JThread(maintainer, std::ref(*this));
-    set_thread_priority(maintainer_thread.value(), 1);
-    callback_thread = JThread(callbacker, std::ref(*this));
-    set_thread_priority(callback_thread.value(), 1);
+    work_queue.resize(config.reaction_flags & rfWorkStealing ? std::max(config.thread_count, 1u) : 1);
+    maintain_queues.reset(new SCQueue<MaintainTask>[config.maintainer_count]);
+    notify_inboxes.reset(new BatchInbox<FrameInstance>[config.maintainer_count]);
+    callback_queues.reset(new SCQueue<CallbackTask>[config.callback_count]);
+    maintainer_threads.reserve(config.maintainer_count);
+    for (size_t i = 0; i < config.maintainer_count; ++i)
+        maintainer_threads.emplace_back(maintainer, std::ref(*this), size_t{i});
+    {
+        std::unique_lock lock(early_mutex);
+        for (auto& [substrate, task] : early_tasks)
+            maintain_queues[shard_of(*this, substrate)].push(std::move(task));
+        early_tasks.clear();
+        maintainers_ready.store(true, std::memory_order_release);
+    }
+    callback_threads.reserve(config.callback_count);
+    for (size_t i = 0; i < config.callback_count; ++i)
+        callback_threads.emplace_back(callbacker, std::ref(*this), size_t{i});
+    auto cpus = worker_cpus(config.affinity);
     for (size_t i = 0; i < config.thread_count; ++i)
-        worker_threads.emplace_back(worker, std::ref(*this));
+        worker_threads.emplace_back(worker, std::ref(*this), size_t{i},
+                                    cpus.empty() ? -1 : static_cast<int>(cpus[i % cpus.size()]));
     logger.log(LogLevel::DEBUG, "Nucleus: reaction started");
 }
 
 bool Nucleus::is_reacting() const noexcept {
-    return !!maintainer_thread;
+    return !maintainer_threads.empty();
 }
 
 Nucleus::~Nucleus() {
-    maintain_queue.request_stop();
-    callback_queue.request_stop();
+    if (maintain_queues)
+        for (size_t i = 0; i < config.maintainer_count; ++i)
+            maintain_queues[i].request_stop();
+    if (callback_queues)
+        for (size_t i = 0; i < config.callback_count; ++i)
+            callback_queues[i].request_stop();
     work_queue.request_stop();
 }
 
-template<typename... Args> static void post_maintain_task(Nucleus& nucl, Args&&... args) noexcept {
-    nucl.maintain_queue.push(MaintainTask{std::forward<Args>(args)...});
+static void post_maintain_task(Nucleus& nucl, const Substrate* substrate, MaintainTask&& task) noexcept {
+    if (!nucl.maintainers_ready.load(std::memory_order_acquire)) [[unlikely]] {
+        std::unique_lock lock(nucl.early_mutex);
+        if (!nucl.maintainers_ready.load(std::memory_order_relaxed)) {
+            nucl.early_tasks.emplace_back(substrate, std::move(task));
+            return;
+        }
+    }
+    nucl.maintain_queues[shard_of(nucl, substrate)].push(std::move(task));
 }
 
-static void post_work_direct(Nucleus& nucl, FrameInstance* inst) noexcept {
+static void mark_ready(Nucleus& nucl, FrameInstance* inst) noexcept {
+    trace(nucl, TraceEvent::Ready, inst);
+    inst->ready_time = std::chrono::steady_clock::now();
+}
+
+static void queue_work(Nucleus& nucl, FrameInstance* inst) noexcept {
+    // priorities start at 1, so band tickets come first
+    inst->priority = nucl.config.reaction_flags & rfCriticalPath ? std::max(~inst->rank, uint64_t{1}) : inst->tick + 1;
     nucl.work_queue.push(inst);
 }
 
-void worker(Nucleus& nucl) {
+static void post_work_direct(Nucleus& nucl, FrameInstance* inst) noexcept {
+    mark_ready(nucl, inst);
+    queue_work(nucl, inst);
+}
+
+// Completions are buffered per shard and published as one batch, so the maintainer is woken once per batch rather
+// than once per frame. Batches are flushed when the worker runs out of work, when they grow large, or right after an
+// expensive frame, whose dependents should not wait for the batch to fill up.
+class Notifier {
+    static constexpr unsigned max_batch = 64;
+    static constexpr uint64_t urgent_cost = 200000;
+
+    Nucleus& nucl;
+    boost::container::small_vector<std::pair<FrameInstance*, FrameInstance*>, 4> batches;
+    unsigned pending = 0;
+
+  public:
+    explicit Notifier(Nucleus& nucl) noexcept : nucl(nucl), batches(nucl.config.maintainer_count) {}
+
+    void add(FrameInstance* inst) noexcept {
+        auto& [first, last] = batches[shard_of(nucl, inst->substrate.get())];
+        inst->batch_next = first;
+        first = inst;
+        if (!last)
+            last = inst;
+        if (++pending >= max_batch || inst->cost >= urgent_cost)
+            flush();
+    }
+
+    void flush() noexcept {
+        if (!pending)
+            return;
+        for (size_t shard = 0; shard < batches.size(); ++shard)
+            if (auto& [first, last] = batches[shard]; first) {
+                if (nucl.notify_inboxes[shard].publish(first, last))
+                    nucl.maintain_queues[shard].wake();
+                first = last = nullptr;
+            }
+        pending = 0;
+    }
+};
+
+void worker(Nucleus& nucl, size_t index, int cpu) {
+    if (cpu >= 0)
+        set_thread_affinity(static_cast<unsigned>(cpu));
+    if (nucl.tracing())
+        nucl.tracer.name_thread(fmt::format("worker {}", index));
+    auto lane = index % nucl.work_queue.size();
+    auto counters = [&](Substrate* substrate) -> WorkerCounters& {
+        return substrate->worker_counters[index % substrate->worker_slots];
+    };
     boost::container::flat_set<Substrate*> inited;
-    nucl.work_queue.stream([&](FrameInstance* inst) {
-        if (inst->taken.test_and_set(std::memory_order_acq_rel))
+    Notifier notifier(nucl);
+    bool idle = false;
+    boost::container::small_vector<FrameInstance*, 8> batch;
+    boost::container::small_vector<CallbackTask, 4> inline_tasks;
+    // the next frame of a single-threaded substrate, run right away without going through the queue
+    FrameInstance* next_serial = nullptr;
+    auto take = [&](FrameInstance* inst) {
+        if (inst->taken.test_and_set(std::memory_order_acq_rel)) {
+            redeem_ticket(inst);
+            return false;
+        }
+        trace(nucl, TraceEvent::Dequeue, inst);
+        if (inst->cancelled.test(std::memory_order_acquire)) {
+            if (inst->single_threaded)
+                next_serial = inst->substrate->executor.finish();
+            inst->skipped = true;
+            inst->exc = std::make_exception_ptr(FrameCancelled());
+            notifier.add(inst);
+            return false;
+        }
+        return true;
+    };
+    auto process = [&](FrameInstance* inst) {
+        if (!take(inst))
             return;
         auto substrate = inst->substrate.get();
         auto filter = substrate->filter.get();
@@ -114,32 +489,117 @@ void worker(Nucleus& nucl) {
             }
         }
         {
-            boost::container::small_vector<const IFrame*, 10> input_frames;
-            for (auto input : inst->inputs)
-                input_frames.push_back(input->product.get());
-            cat_ptr<const IFrame> product;
+            batch.assign(1, inst);
+            auto filter2 = dynamic_cast<IFilter2*>(filter);
+            if (filter2)
+                for (auto max_batch = filter2->get_max_batch(); batch.size() < max_batch;) {
+                    auto next = nucl.work_queue.pop_if(lane, [=](FrameInstance* other) {
+                        return other->substrate.get() == substrate;
+                    });
+                    if (!next)
+                        break;
+                    if (take(*next))
+                        batch.push_back(*next);
+                }
+            auto count = batch.size();
+            boost::container::small_vector<boost::container::small_vector<const IFrame*, 10>, 8> input_frames(count);
+            boost::container::small_vector<const IFrame* const*, 8> input_lists(count);
+            boost::container::small_vector<size_t, 8> frame_indices(count);
+            boost::container::small_vector<FrameData*, 8> frame_data(count);
+            boost::container::small_vector<const IFrame*, 8> products(count);
+            for (size_t i = 0; i < count; ++i) {
+                // inputs released early in a previous round are passed as null
+                for (auto input : batch[i]->inputs)
+                    input_frames[i].push_back(input ? input->product.get() : nullptr);
+                input_lists[i] = input_frames[i].data();
+                frame_indices[i] = batch[i]->frame_idx;
+                frame_data[i] = batch[i]->frame_data;
+                trace(nucl, TraceEvent::ProcessStart, batch[i]);
+            }
+            std::exception_ptr exc;
+            current_instance = inst;
+            current_batched = count > 1;
+            auto start = std::chrono::steady_clock::now();
             try {
-                filter->process_frame(input_frames.data(), &inst->frame_data, product.put_const());
-                filter->drop_frame_data(inst->frame_data);
+                if (count == 1)
+                    filter->process_frame(input_lists[0], &frame_data[0], &products[0]);
+                else
+                    filter2->process_frames(count, frame_indices.data(), input_lists.data(), frame_data.data(),
+                                            products.data());
+                // a frame without a product keeps its frame data for the next round
+                for (size_t i = 0; i < count; ++i)
+                    if (products[i])
+                        filter->drop_frame_data(std::exchange(frame_data[i], nullptr));
             } catch (...) {
-                post_maintain_task(nucl, inst, std::current_exception());
-                return;
+                exc = std::current_exception();
+                for (auto& product : products)
+                    if (product)
+                        std::exchange(product, nullptr)->release();
+            }
+            current_instance = nullptr;
+            // a batch is accounted as count frames of equal cost
+            auto cost = static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() /
+                count);
+            auto& c = counters(substrate);
+            for (size_t i = 0; i < count; ++i) {
+                auto member = batch[i];
+                trace(nucl, TraceEvent::ProcessEnd, member);
+                member->cost = cost;
+                // on failure or another round the frame data is left to the maintainer
+                member->frame_data = frame_data[i];
+                member->exc = exc;
+                *member->product.put_const() = products[i];
+                c.wait_ns.fetch_add(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(start - member->ready_time).count(),
+                    std::memory_order_relaxed);
+            }
+            c.frames.fetch_add(count, std::memory_order_relaxed);
+            c.process_ns.fetch_add(cost * count, std::memory_order_relaxed);
+            c.histogram[std::min<unsigned>(std::bit_width(cost), WorkerCounters::histogram_size - 1)].fetch_add(
+                static_cast<uint32_t>(count), std::memory_order_relaxed);
+            // racy read-modify-write: a lost update only delays the average a little
+            auto mean = substrate->mean_cost.load(std::memory_order_relaxed);
+            substrate->mean_cost.store(mean ? mean - mean / 8 + cost / 8 : cost, std::memory_order_relaxed);
+            // the inline callbacks and the next serial frame are taken before the frames are handed back, after which
+            // the maintainer may free them
+            for (auto member : batch)
+                if (member->exc || member->product)
+                    for (auto& delivery : close_inline(member))
+                        inline_tasks.push_back(CallbackTask{std::move(delivery.callback), member->product, member->exc,
+                                                            substrate->serial, member->frame_idx, member});
+            if (inst->single_threaded)
+                next_serial = substrate->executor.finish(inst, !inst->exc && !inst->product);
+            for (auto member : batch)
+                notifier.add(member);
+            if (!inline_tasks.empty()) {
+                // published first, so the dependents do not wait for the callbacks
+                notifier.flush();
+                for (auto& task : inline_tasks)
+                    run_callback(nucl, std::move(task));
+                inline_tasks.clear();
             }
-            inst->product = std::move(product);
-            post_maintain_task(nucl, inst);
             return;
         }
     repost:
-        ++inst->tick;
+        ++inst->priority;
         inst->taken.clear(std::memory_order_release);
         nucl.work_queue.push(inst);
+    };
+    nucl.work_queue.stream(lane, [&](FrameInstance* inst) {
+        if (idle) {
+            nucl.idle_workers.fetch_sub(1, std::memory_order_relaxed);
+            idle = false;
+        }
+        for (; inst; inst = std::exchange(next_serial, nullptr))
+            process(inst);
+    }, [&]() {
+        notifier.flush();
+        nucl.idle_workers.fetch_add(1, std::memory_order_relaxed);
+        idle = true;
     });
 }
 
-static bool check_all_inputs_ready(FrameInstance* inst) {
-    return std::all_of(inst->inputs.begin(), inst->inputs.end(), [](FrameInstance* input) { return !!input->product; });
-}
-
 template<typename A, typename B> struct std::hash<std::pair<A, B>> {
     size_t operator()(const std::pair<A, B>& v) const noexcept {
         size_t seed = 0;
@@ -149,199 +609,750 @@ template<typename A, typename B> struct std::hash<std::pair<A, B>> {
     }
 };
 
-static FrameInstance*
-construct(Nucleus& nucl, size_t tick,
-          std::unordered_map<std::pair<Substrate*, size_t>, std::unique_ptr<FrameInstance>>& instances,
-          std::unordered_set<FrameInstance*>& alive,
-          std::unordered_map<Substrate*, std::pair<bool, std::set<FrameInstance*, FrameInstanceTickGreater>>>& neck,
-          std::unordered_set<std::pair<Substrate*, size_t>>& history, std::unordered_map<Substrate*, unsigned>& miss,
-          Substrate* substrate, size_t frame_idx, cat_ptr<ICallback> callback = {}, bool missed = false) noexcept;
+template<typename F> static size_t sum_planes(const IFrame* frame, F&& f) noexcept {
+    size_t bytes = 0;
+    for (unsigned idx = 0; idx < num_planes(frame->get_frame_info().format); ++idx)
+        bytes += f(frame->get_plane(idx));
+    return bytes;
+}
+
+// the size a cached frame is weighed by, with views counted at their parent's size even if that is charged elsewhere
+static size_t frame_bytes(const IFrame* frame) noexcept {
+    return sum_planes(frame, buffer_bytes);
+}
 
-static void kill_tree(Nucleus& nucl, FrameInstance* inst, std::unordered_set<FrameInstance*>& alive,
-                      std::exception_ptr exc) noexcept;
+// Stores the result of a request and wakes the thread waiting for it. Invoking it is cheap and never blocks, so it
+// is requested on the inline lane.
+class FrameSlot : virtual public ICallback {
+    std::atomic_flag done;
+    cat_ptr<const IFrame> frame;
+    std::exception_ptr exc;
 
-static void post_work(
-    Nucleus& nucl, FrameInstance* inst,
-    std::unordered_map<Substrate*, std::pair<bool, std::set<FrameInstance*, FrameInstanceTickGreater>>>& neck) noexcept;
+  public:
+    void invoke(const IFrame* frame, std::exception_ptr exc) noexcept final {
+        this->frame = frame;
+        this->exc = std::move(exc);
+        done.test_and_set(std::memory_order_release);
+        done.notify_one();
+    }
 
-static void post_callback(Nucleus& nucl, cat_ptr<ICallback>&& callback, cat_ptr<const IFrame> frame,
+    // waits for the result, after which the slot can be requested again
+    std::exception_ptr take(cat_ptr<const IFrame>& frame) noexcept {
+        done.wait(false, std::memory_order_acquire);
+        done.clear(std::memory_order_relaxed);
+        frame = std::move(this->frame);
+        return std::exchange(exc, nullptr);
+    }
+};
+
+// The callback of get_frame_blocking, one per thread. The thread holds a reference of its own, hence the waiter is
+// never dropped.
+class FrameWaiter final : public FrameSlot {
+  public:
+    FrameWaiter() noexcept {
+        add_ref();
+    }
+
+    void drop() noexcept final {}
+
+    void wait(const IFrame** out) {
+        cat_ptr<const IFrame> frame;
+        if (auto e = take(frame))
+            std::rethrow_exception(e);
+        *out = frame.detach();
+    }
+};
+
+static void run_callback(Nucleus& nucl, CallbackTask&& task) noexcept {
+    if (auto waiter = dynamic_cast<FrameWaiter*>(task.callback.get())) {
+        // released first: once woken, the waiting thread may reuse the waiter right away
+        task.callback = nullptr;
+        waiter->invoke(task.frame.get(), std::move(task.exc));
+    } else
+        task.callback->invoke(task.frame.get(), std::move(task.exc));
+    if (nucl.tracing()) [[unlikely]]
+        nucl.tracer.record(TraceEvent::Callback, task.substrate, task.frame_idx, task.inst);
+}
+
+// Each output delivers through one lane, either a callback thread or inline, so its callbacks stay in order. Inline
+// callbacks are normally run by the worker finishing the frame; those the maintainer delivers itself, for cached,
+// failed or cancelled frames, go to a callback thread unless they are frame slots, which never block.
+static void post_callback(Nucleus& nucl, const FrameInstance* inst, Delivery&& delivery, cat_ptr<const IFrame> frame,
                           std::exception_ptr exc) noexcept {
-    auto cb{std::move(callback)};
-    nucl.callback_queue.push(CallbackTask{[=]() { cb->invoke(frame.get(), exc); }});
-}
-
-void maintainer(Nucleus& nucl) {
-    std::unordered_map<std::pair<Substrate*, size_t>, std::unique_ptr<FrameInstance>> instances;
-    std::unordered_set<FrameInstance*> alive;
-    std::unordered_map<Substrate*, std::pair<bool, std::set<FrameInstance*, FrameInstanceTickGreater>>> neck;
-    std::unordered_set<std::pair<Substrate*, size_t>> history;
-    std::unordered_map<Substrate*, unsigned> miss;
-    size_t tick = 0;
-    while (true) {
-        bool constructed = false;
-        nucl.maintain_queue.consume_all([&](MaintainTask&& task) {
-            if (task.index()) {
-                auto& t = std::get<Notify>(task);
-                auto inst = t.inst;
-                auto exc = t.exc;
-                if (alive.find(inst) != alive.end()) {
-                    if (inst->single_threaded) {
-                        auto& item = neck[inst->substrate.get()];
-                        item.first = false;
-                        item.second.erase(inst);
-                        inst->single_threaded = false;
-                    }
-                    if (!exc)
-                        for (auto output : inst->outputs)
-                            if (alive.find(output) != alive.end() && !output->product && check_all_inputs_ready(output))
-                                post_work(nucl, output, neck);
-                    if (exc) {
-                        kill_tree(nucl, inst, alive, exc);
-                        for (auto it = instances.begin(); it != instances.end();) {
-                            if (alive.find(it->second.get()) == alive.end())
-                                it = instances.erase(it);
-                            else
-                                ++it;
-                        }
-                    } else if (inst->callback)
-                        post_callback(nucl, std::move(inst->callback), inst->product, exc);
-                }
-            } else {
-                auto& t = std::get<Construct>(task);
-                construct(nucl, tick, instances, alive, neck, history, miss, t.substrate.get(), t.frame_idx,
-                          std::move(t.callback));
-                constructed = true;
+    CallbackTask task{std::move(delivery.callback), std::move(frame), std::move(exc), inst->substrate->serial,
+                      inst->frame_idx, inst};
+    if (delivery.lane != inline_lane)
+        nucl.callback_queues[delivery.lane].push(std::move(task));
+    else if (dynamic_cast<FrameSlot*>(task.callback.get()))
+        run_callback(nucl, std::move(task));
+    else
+        nucl.callback_queues[delivery.request_id % nucl.config.callback_count].push(std::move(task));
+}
+
+// Each maintainer owns the instances of the substrates sharded to it. Dependency edges crossing shards are handed
+// off as Link/Feed/Fail tasks through the lock-free queues, so no instance state is shared between maintainers
+// except the consumers counter.
+class Maintainer {
+    Nucleus& nucl;
+    const size_t shard;
+
+    Slab<FrameInstance> slab;
+    FlatMap<std::pair<Substrate*, size_t>, FrameInstance*> instances;
+    std::vector<FrameInstance*> zombies;
+    FlatMap<std::pair<Substrate*, size_t>, bool> history;
+    // finished instances no longer needed by any output, evicted by GreedyDual-Size-Frequency:
+    // the priority is clock + hits * cost / bytes, and the clock ages to the priority of the last victim
+    std::set<std::pair<double, FrameInstance*>> cache;
+    double clock = 0;
+    std::deque<MaintainTask> local;
+    bool constructed = false;
+    bool notified = false;
+
+    void send(const Substrate* substrate, MaintainTask&& task) noexcept {
+        if (auto target = shard_of(nucl, substrate); target == shard)
+            local.emplace_back(std::move(task));
+        else
+            nucl.maintain_queues[target].push(std::move(task));
+    }
+
+    void post_work(FrameInstance* inst) noexcept {
+        if (!inst->single_threaded)
+            return post_work_direct(nucl, inst);
+        auto& executor = inst->substrate->executor;
+        mark_ready(nucl, inst);
+        executor.post(inst);
+        if (auto next = executor.claim())
+            queue_work(nucl, next);
+    }
+
+    void uncache(FrameInstance* inst) noexcept {
+        if (inst->cached) {
+            cache.erase(std::make_pair(inst->cache_priority, inst));
+            inst->cached = false;
+        }
+    }
+
+    void hit(FrameInstance* inst) noexcept {
+        if (inst->done) {
+            ++inst->hits;
+            uncache(inst);
+        }
+    }
+
+    void attach(FrameInstance* input, FrameInstance* output, unsigned slot) noexcept {
+        hit(input);
+        input->consumers.fetch_add(1, std::memory_order_relaxed);
+        if (input->done)
+            send(output->substrate.get(), Feed{output, slot, input});
+        else
+            input->outputs.emplace_back(output, slot);
+    }
+
+    static void release_inputs(FrameInstance* inst) noexcept {
+        for (auto& input : inst->inputs)
+            if (input) {
+                input->consumers.fetch_sub(1, std::memory_order_release);
+                input = nullptr;
             }
-            for (auto& item : neck)
-                if (auto& sec = item.second; !sec.first && !sec.second.empty()) {
-                    auto top = sec.second.end();
-                    post_work_direct(nucl, *--top);
-                    sec.second.erase(top);
-                    sec.first = true;
+    }
+
+    // frames not measured yet still count, so that deeper chains rank higher
+    static uint64_t estimated_cost(const Substrate* substrate) noexcept {
+        return std::max(substrate->mean_cost.load(std::memory_order_relaxed), uint64_t{1000});
+    }
+
+    FrameInstance* instantiate(Substrate* substrate, size_t frame_idx, size_t tick, bool missed,
+                               uint64_t rank) noexcept {
+        auto key = std::make_pair(substrate, frame_idx);
+        rank += estimated_cost(substrate);
+        if (auto it = instances.find(key)) {
+            // needed again; a worker that has already skipped it is handled in notify
+            (*it)->cancelled.clear(std::memory_order_relaxed);
+            // not propagated to the inputs already linked, which keep their lower rank
+            (*it)->rank = std::max((*it)->rank, rank);
+            return *it;
+        }
+        if (!history.try_emplace(key).second && !missed) {
+            nucl.logger.log(LogLevel::DEBUG, format_c("Nucleus: frame {} of substrate {} need to recalculate",
+                                                      frame_idx, static_cast<void*>(substrate)));
+            missed = true;
+            substrate->recomputes.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        auto filter = substrate->filter.get();
+        FrameData* frame_data = nullptr;
+        filter->get_frame_data(frame_idx, &frame_data);
+        auto ff = filter->get_filter_flags();
+        FrameInstance* prev = nullptr;
+        if ((ff & ffMakeLinear) && frame_idx)
+            if (auto it = instances.find(std::make_pair(substrate, frame_idx - 1)))
+                prev = *it;
+
+        auto inst = slab.make(substrate, frame_idx, frame_data, tick);
+        inst->rank = rank;
+        instances.try_emplace(key, inst);
+        trace(nucl, TraceEvent::Construct, inst);
+        substrate->in_flight.fetch_add(1, std::memory_order_relaxed);
+        auto count = frame_data->dependency_count;
+        inst->inputs.resize(count + !!prev);
+        inst->waiting = static_cast<unsigned>(count + !!prev);
+        if (ff & ffSingleThreaded)
+            inst->single_threaded = true;
+
+        for (size_t i = 0; i < count; ++i) {
+            auto dep = frame_data->dependencies[i];
+            auto dep_substrate = &dynamic_cast<Substrate&>(*const_cast<ISubstrate*>(dep.substrate));
+            send(dep_substrate, Link{dep_substrate, dep.frame_idx, inst, static_cast<unsigned>(i), tick, missed, rank});
+        }
+        if (prev) {
+            attach(prev, inst, static_cast<unsigned>(count));
+            inst->false_dep = true;
+        }
+
+        if (!inst->waiting)
+            post_work(inst);
+        return inst;
+    }
+
+    void kill(FrameInstance* inst, std::exception_ptr exc) noexcept {
+        inst->dead = true;
+        inst->substrate->in_flight.fetch_sub(1, std::memory_order_relaxed);
+        inst->substrate->filter->drop_frame_data(inst->frame_data);
+        // killed between its rounds, an ffSerialRounds frame no longer holds back the other frames
+        if (auto& executor = inst->substrate->executor; executor.retire(inst))
+            if (auto next = executor.claim())
+                queue_work(nucl, next);
+        for (auto& delivery : inst->callbacks)
+            post_callback(nucl, inst, std::move(delivery), nullptr, exc);
+        inst->callbacks.clear();
+        // those of a frame failed by a worker have been run by it already
+        for (auto& delivery : close_inline(inst))
+            post_callback(nucl, inst, std::move(delivery), nullptr, exc);
+        for (auto [output, slot] : inst->outputs)
+            send(output->substrate.get(), Fail{output, exc});
+        inst->consumers.fetch_sub(inst->outputs.size(), std::memory_order_relaxed);
+        inst->outputs.clear();
+        release_inputs(inst);
+        instances.erase(std::make_pair(inst->substrate.get(), inst->frame_idx));
+        zombies.push_back(inst);
+    }
+
+    // Links the dependencies the filter has appended to the frame data of an instance it returned no product for.
+    // They are inserted before the false dependency, so the slots of the inputs already fed stay where they are.
+    void extend(FrameInstance* inst) noexcept {
+        auto frame_data = inst->frame_data;
+        auto linked = inst->inputs.size() - inst->false_dep;
+        auto count = frame_data ? frame_data->dependency_count : 0;
+        if (count <= linked) {
+            kill(inst, std::make_exception_ptr(std::runtime_error("filter produced no frame")));
+            return;
+        }
+        inst->taken.clear(std::memory_order_relaxed);
+        inst->inputs.insert(inst->inputs.begin() + linked, count - linked, nullptr);
+        inst->waiting = static_cast<unsigned>(count - linked);
+        for (auto i = linked; i < count; ++i) {
+            auto dep = frame_data->dependencies[i];
+            auto dep_substrate = &dynamic_cast<Substrate&>(*const_cast<ISubstrate*>(dep.substrate));
+            send(dep_substrate,
+                 Link{dep_substrate, dep.frame_idx, inst, static_cast<unsigned>(i), inst->tick, false, inst->rank});
+        }
+    }
+
+    void handle(Construct& t) noexcept {
+        auto inst = instantiate(t.substrate.get(), t.frame_idx, t.tick, false, 0);
+        hit(inst);
+        if (t.callback) {
+            Delivery delivery{t.request_id, std::move(t.callback), t.lane};
+            if (inst->done)
+                post_callback(nucl, inst, std::move(delivery), inst->product, {});
+            else if (delivery.lane != inline_lane || !adopt_inline(inst, delivery))
+                inst->callbacks.push_back(std::move(delivery));
+        }
+        constructed = true;
+    }
+
+    static bool needed(FrameInstance* inst) noexcept {
+        if (!inst->callbacks.empty() || !inst->outputs.empty())
+            return true;
+        inst->inline_lock.acquire();
+        auto waiting = !inst->inline_callbacks.empty();
+        inst->inline_lock.release();
+        return waiting;
+    }
+
+    // Drops an unfinished instance nothing needs any more. Instances still waiting for inputs are killed right away
+    // and unlinked from the inputs not fed yet, which may in turn withdraw those; instances already handed to the
+    // workers are flagged, so the worker skips them unless one has started processing.
+    void withdraw(FrameInstance* inst) noexcept {
+        if (inst->done || needed(inst))
+            return;
+        auto exc = std::make_exception_ptr(FrameCancelled());
+        if (inst->waiting) {
+            auto frame_data = inst->frame_data;
+            for (size_t i = 0; i < frame_data->dependency_count; ++i)
+                if (!inst->inputs[i]) {
+                    auto dep = frame_data->dependencies[i];
+                    auto dep_substrate = &dynamic_cast<Substrate&>(*const_cast<ISubstrate*>(dep.substrate));
+                    send(dep_substrate, Unlink{dep_substrate, dep.frame_idx, inst});
                 }
-        });
-        ++tick;
-        if (constructed) {
-            for (auto it = instances.begin(); it != instances.end();) {
-                auto inst = it->second.get();
-                if (!inst->product || inst->callback || inst->single_threaded)
-                    goto next;
-                for (auto output : inst->outputs)
-                    if (alive.find(output) != alive.end() && !output->product)
-                        goto next;
-                if (inst->indulgence--)
-                    goto next;
-                it = instances.erase(it);
-                alive.erase(inst);
-                continue;
-            next:
-                ++it;
-            }
-            if (history.size() > 65535)
-                history.clear();
+            if (inst->false_dep && !inst->inputs.back())
+                send(inst->substrate.get(), Unlink{inst->substrate.get(), inst->frame_idx - 1, inst});
+            kill(inst, std::move(exc));
+        } else if (inst->single_threaded && inst->substrate->executor.withdraw(inst))
+            kill(inst, std::move(exc));
+        else
+            inst->cancelled.test_and_set(std::memory_order_release);
+    }
+
+    static bool take_delivery(boost::container::small_vector<Delivery, 1>& deliveries, size_t request_id,
+                              Delivery& out) noexcept {
+        auto it = std::find_if(deliveries.begin(), deliveries.end(),
+                               [&](const auto& item) { return item.request_id == request_id; });
+        if (it == deliveries.end())
+            return false;
+        out = std::move(*it);
+        deliveries.erase(it);
+        return true;
+    }
+
+    void handle(Cancel& t) noexcept {
+        for (auto idx = t.prefetch_first; idx < t.prefetch_last; ++idx)
+            if (auto it = instances.find(std::make_pair(t.substrate.get(), idx)))
+                withdraw(*it);
+        auto it = instances.find(std::make_pair(t.substrate.get(), t.frame_idx));
+        if (!it || (*it)->done)
+            return;
+        auto inst = *it;
+        Delivery delivery{};
+        if (!take_delivery(inst->callbacks, t.request_id, delivery)) {
+            // an inline callback the worker has taken is run with the product
+            inst->inline_lock.acquire();
+            auto found = take_delivery(inst->inline_callbacks, t.request_id, delivery);
+            inst->inline_lock.release();
+            if (!found)
+                return;
         }
+        post_callback(nucl, inst, std::move(delivery), nullptr, std::make_exception_ptr(FrameCancelled()));
+        withdraw(inst);
     }
-}
 
-FrameInstance*
-construct(Nucleus& nucl, size_t tick,
-          std::unordered_map<std::pair<Substrate*, size_t>, std::unique_ptr<FrameInstance>>& instances,
-          std::unordered_set<FrameInstance*>& alive,
-          std::unordered_map<Substrate*, std::pair<bool, std::set<FrameInstance*, FrameInstanceTickGreater>>>& neck,
-          std::unordered_set<std::pair<Substrate*, size_t>>& history, std::unordered_map<Substrate*, unsigned>& miss,
-          Substrate* substrate, size_t frame_idx, cat_ptr<ICallback> callback, bool missed) noexcept {
-    auto key = std::make_pair(substrate, frame_idx);
-    if (auto it = instances.find(key); it != instances.end()) {
-        auto inst = it->second.get();
-        if (callback) {
-            if (inst->product)
-                post_callback(nucl, std::move(callback), inst->product, {});
-            else
-                inst->callback = std::move(callback);
+    void handle(Unlink& t) noexcept {
+        auto it = instances.find(std::make_pair(t.substrate, t.frame_idx));
+        if (!it)
+            return;
+        auto inst = *it;
+        auto& outputs = inst->outputs;
+        auto link = std::find_if(outputs.begin(), outputs.end(),
+                                 [&](const auto& item) { return item.first == t.output; });
+        if (link == outputs.end())
+            return;
+        outputs.erase(link);
+        inst->consumers.fetch_sub(1, std::memory_order_relaxed);
+        send(t.output->substrate.get(), Fail{t.output, std::make_exception_ptr(FrameCancelled())});
+        withdraw(inst);
+    }
+
+    void notify(FrameInstance* inst) noexcept {
+        notified = true;
+        if (inst->skipped && needed(inst)) {
+            // requested again after the worker had skipped it
+            inst->skipped = false;
+            inst->exc = nullptr;
+            inst->cancelled.clear(std::memory_order_relaxed);
+            inst->taken.clear(std::memory_order_relaxed);
+            post_work(inst);
+            return;
+        }
+        if (!inst->exc && !inst->product) {
+            extend(inst);
+            return;
+        }
+        inst->single_threaded = false;
+        release_inputs(inst);
+        if (inst->exc)
+            kill(inst, std::move(inst->exc));
+        else {
+            inst->done = true;
+            inst->bytes = frame_bytes(inst->product.get());
+            nucl.product_bytes.fetch_add(sum_planes(inst->product.get(), charge_bytes), std::memory_order_relaxed);
+            inst->substrate->in_flight.fetch_sub(1, std::memory_order_relaxed);
+            inst->substrate->bytes_produced.fetch_add(inst->bytes, std::memory_order_relaxed);
+            for (auto [output, slot] : inst->outputs)
+                send(output->substrate.get(), Feed{output, slot, inst});
+            inst->outputs.clear();
+            for (auto& delivery : inst->callbacks)
+                post_callback(nucl, inst, std::move(delivery), inst->product, {});
+            inst->callbacks.clear();
         }
-        return inst;
     }
-    if (auto it = history.find(key); it != history.end() && !missed) {
-        nucl.logger.log(LogLevel::DEBUG, format_c("Nucleus: frame {} of substrate {} need to recalculate", frame_idx,
-                                                  static_cast<void*>(substrate)));
-        missed = true;
-        ++miss[substrate];
-    } else
-        history.emplace(key);
-
-    auto filter = substrate->filter.get();
-    FrameData* frame_data = nullptr;
-    filter->get_frame_data(frame_idx, &frame_data);
-    auto instc = std::make_unique<FrameInstance>(substrate, frame_data, tick);
-    for (size_t i = 0; i < frame_data->dependency_count; ++i) {
-        auto dep = frame_data->dependencies[i];
-        auto input = construct(nucl, tick, instances, alive, neck, history, miss,
-                               &dynamic_cast<Substrate&>(*const_cast<ISubstrate*>(dep.substrate)), dep.frame_idx,
-                               nullptr, missed);
-        instc->inputs.emplace_back(input);
-        input->outputs.emplace_back(instc.get());
-    }
-
-    auto ff = filter->get_filter_flags();
-    if ((ff & ffMakeLinear) && frame_idx)
-        if (auto prev = instances.find(std::make_pair(substrate, frame_idx - 1)); prev != instances.end()) {
-            auto input = prev->second.get();
-            instc->inputs.emplace_back(input);
-            input->outputs.emplace_back(instc.get());
-            instc->false_dep = true;
+
+    void handle(Link& t) noexcept {
+        attach(instantiate(t.substrate, t.frame_idx, t.tick, t.missed, t.rank), t.output, t.slot);
+        constructed = true;
+    }
+
+    void handle(Feed& t) noexcept {
+        auto output = t.output;
+        output->inputs[t.slot] = t.input;
+        --output->waiting;
+        if (output->dead)
+            release_inputs(output);
+        else if (!output->waiting)
+            post_work(output);
+    }
+
+    void handle(Fail& t) noexcept {
+        --t.output->waiting;
+        if (!t.output->dead)
+            kill(t.output, t.exc);
+    }
+
+    void dispatch(MaintainTask&& task) noexcept {
+        std::visit([this](auto& t) { handle(t); }, task);
+    }
+
+    bool over_budget() const noexcept {
+        return nucl.product_bytes.load(std::memory_order_relaxed) > size_t{nucl.config.mem_hint_mb} << 20;
+    }
+
+    void cleanup() noexcept {
+        instances.for_each([this](auto&, FrameInstance* inst) {
+            if (inst->done && !inst->cached && !inst->consumers.load(std::memory_order_acquire)) {
+                inst->cache_priority =
+                    clock + static_cast<double>(inst->hits) * static_cast<double>(inst->cost) /
+                                static_cast<double>(std::max(inst->bytes, size_t{1}));
+                cache.emplace(inst->cache_priority, inst);
+                inst->cached = true;
+            }
+        });
+        std::erase_if(zombies, [this](FrameInstance* inst) {
+            if (inst->waiting || inst->consumers.load(std::memory_order_acquire))
+                return false;
+            slab.destroy(inst);
+            return true;
+        });
+        if (history.size() > 65535)
+            history.clear();
+    }
+
+    void evict() noexcept {
+        while (over_budget() && !cache.empty()) {
+            auto [priority, inst] = *cache.begin();
+            cache.erase(cache.begin());
+            clock = priority;
+            nucl.product_bytes.fetch_sub(sum_planes(inst->product.get(), uncharge_bytes), std::memory_order_relaxed);
+            instances.erase(std::make_pair(inst->substrate.get(), inst->frame_idx));
+            slab.destroy(inst);
         }
-    if (ff & ffSingleThreaded)
-        instc->single_threaded = true;
+    }
 
-    if (auto it = miss.find(substrate); it != miss.end())
-        instc->indulgence = it->second / 8;
+    void settle() noexcept {
+        while (!local.empty()) {
+            auto t = std::move(local.front());
+            local.pop_front();
+            dispatch(std::move(t));
+        }
+    }
 
-    instc->callback = std::move(callback);
-    auto inst = instances.emplace(key, std::move(instc)).first->second.get();
-    alive.emplace(inst);
+  public:
+    Maintainer(Nucleus& nucl, size_t shard) noexcept : nucl(nucl), shard(shard) {}
 
-    if (check_all_inputs_ready(inst))
-        post_work(nucl, inst, neck);
+    ~Maintainer() {
+        instances.for_each([this](auto&, FrameInstance* inst) {
+            // the buffers may outlive the nucleus in frames held by the user
+            if (inst->done)
+                sum_planes(inst->product.get(), uncharge_bytes);
+            slab.destroy(inst);
+        });
+        for (auto inst : zombies)
+            slab.destroy(inst);
+    }
 
-    return inst;
-}
+    void run() {
+        auto& queue = nucl.maintain_queues[shard];
+        auto& inbox = nucl.notify_inboxes[shard];
+        while (true) {
+            constructed = false;
+            notified = false;
+            bool idle = true;
+            for (auto inst = inbox.take(); inst;) {
+                auto next = inst->batch_next;
+                notify(inst);
+                settle();
+                inst = next;
+                idle = false;
+            }
+            while (auto task = queue.pop<false>()) {
+                dispatch(std::move(task.value()));
+                settle();
+                idle = false;
+            }
+            if (constructed || (notified && over_budget()))
+                cleanup();
+            evict();
+            if (idle)
+                queue.wait();
+        }
+    }
+};
 
-void kill_tree(Nucleus& nucl, FrameInstance* inst, std::unordered_set<FrameInstance*>& alive,
-               std::exception_ptr exc) noexcept {
-    inst->substrate->filter->drop_frame_data(inst->frame_data);
-    if (inst->callback)
-        post_callback(nucl, std::move(inst->callback), nullptr, exc);
-    for (auto output : inst->outputs)
-        if (alive.find(output) != alive.end())
-            kill_tree(nucl, output, alive, exc);
-    alive.erase(inst);
+void maintainer(Nucleus& nucl, size_t shard) {
+    set_thread_priority(1, true, nucl.config.reaction_flags & rfRealtime);
+    if (nucl.tracing())
+        nucl.tracer.name_thread(fmt::format("maintainer {}", shard));
+    Maintainer{nucl, shard}.run();
 }
 
-void post_work(Nucleus& nucl, FrameInstance* inst,
-               std::unordered_map<Substrate*, std::pair<bool, std::set<FrameInstance*, FrameInstanceTickGreater>>>&
-                   neck) noexcept {
-    if (!inst->single_threaded)
-        post_work_direct(nucl, inst);
-    else
-        neck[inst->substrate.get()].second.insert(inst);
+void callbacker(Nucleus& nucl, size_t lane) {
+    set_thread_priority(1, true, nucl.config.reaction_flags & rfRealtime);
+    if (nucl.tracing())
+        nucl.tracer.name_thread(fmt::format("callback {}", lane));
+    nucl.callback_queues[lane].stream([&nucl](CallbackTask&& task) {
+        task.callback->invoke(task.frame.get(), task.exc);
+        if (nucl.tracing()) [[unlikely]]
+            nucl.tracer.record(TraceEvent::Callback, task.substrate, task.frame_idx, task.inst);
+    });
 }
 
-void callbacker(Nucleus& nucl) {
-    nucl.callback_queue.stream([](CallbackTask&& task) { task.callback(); });
-}
+class Request final : public Object, virtual public IRequest, public Shuttle {
+    cat_ptr<Substrate> substrate;
+    size_t frame_idx;
+    size_t request_id;
+    std::pair<size_t, size_t> prefetched;
+    std::atomic_flag cancelled;
+
+  public:
+    void cancel() noexcept final {
+        if (!cancelled.test_and_set(std::memory_order_relaxed))
+            post_maintain_task(nucl, substrate.get(),
+                               Cancel{substrate, frame_idx, request_id, prefetched.first, prefetched.second});
+    }
+
+    Request(Nucleus& nucl, cat_ptr<Substrate> substrate, size_t frame_idx, size_t request_id,
+            std::pair<size_t, size_t> prefetched) noexcept
+        : Shuttle(nucl), substrate(std::move(substrate)), frame_idx(frame_idx), request_id(request_id),
+          prefetched(prefetched) {}
+};
+
+class StreamSlot final : public Object, public FrameSlot {
+  public:
+    size_t frame_idx;
+    size_t request_id;
+};
+
+class OutputStream final : public Object, virtual public IOutputStream, public Shuttle {
+    cat_ptr<Substrate> substrate;
+    size_t next_idx;
+    size_t last;
+    // frame idx is delivered to slots[(idx - first) % window]
+    size_t first;
+    std::vector<cat_ptr<StreamSlot>> slots;
+
+    void request(StreamSlot* slot, size_t frame_idx) noexcept {
+        slot->frame_idx = frame_idx;
+        slot->request_id = nucl.request_serial.fetch_add(1, std::memory_order_relaxed);
+        auto tick = nucl.tick.fetch_add(1, std::memory_order_relaxed);
+        post_maintain_task(nucl, substrate.get(),
+                           Construct{substrate, frame_idx, slot, tick, slot->request_id, inline_lane});
+    }
+
+  public:
+    bool next(const IFrame** out) final {
+        if (next_idx == last)
+            return false;
+        auto idx = next_idx++;
+        auto slot = slots[(idx - first) % slots.size()].get();
+        cat_ptr<const IFrame> frame;
+        auto exc = slot->take(frame);
+        // refilled before rethrowing, so a failed frame does not shrink the window
+        if (idx + slots.size() < last)
+            request(slot, idx + slots.size());
+        if (exc)
+            std::rethrow_exception(exc);
+        *out = frame.detach();
+        return true;
+    }
+
+    OutputStream(Nucleus& nucl, cat_ptr<Substrate> substrate, size_t first, size_t last, size_t window) noexcept
+        : Shuttle(nucl), substrate(std::move(substrate)), next_idx(first), last(last), first(first) {
+        slots.reserve(std::min(window, last - first));
+        for (auto idx = first; idx < last && slots.size() < window; ++idx)
+            request(slots.emplace_back(new StreamSlot).get(), idx);
+    }
+
+    // the slots not taken yet are still referenced by their requests until cancelled
+    ~OutputStream() final {
+        for (auto idx = next_idx; idx < last && idx < next_idx + slots.size(); ++idx) {
+            auto slot = slots[(idx - first) % slots.size()].get();
+            post_maintain_task(nucl, substrate.get(), Cancel{substrate, slot->frame_idx, slot->request_id});
+        }
+    }
+};
+
+class Output final : public Object, virtual public IOutput1, public Shuttle {
+    // requests in order before the access counts as sequential
+    static constexpr unsigned sequential_run = 2;
+
+    std::mutex mutex;
+    size_t max_window;
+    size_t window = 1;
+    size_t next_idx = 0;
+    unsigned run = 0;
+    // frames below it have been requested or prefetched
+    size_t prefetched = 0;
+    const size_t serial;
+    std::atomic_bool inline_callbacks;
+
+    unsigned lane() const noexcept {
+        return inline_callbacks.load(std::memory_order_relaxed)
+                   ? inline_lane
+                   : static_cast<unsigned>(serial % nucl.config.callback_count);
+    }
+
+    // Frame idx + k is constructed with tick + k, the tick it would get if requested k calls later, so prefetching
+    // never overtakes the requests actually made. The window doubles while workers are idle and halves when the
+    // products approach the memory budget, where prefetched frames would be evicted before they are requested.
+    // Returns the range of frames constructed by this call.
+    std::pair<size_t, size_t> prefetch(size_t frame_idx, size_t tick) noexcept {
+        std::unique_lock lock(mutex);
+        if (frame_idx == next_idx)
+            ++run;
+        else {
+            run = 0;
+            window = 1;
+            prefetched = 0;
+        }
+        next_idx = frame_idx + 1;
+        if (!max_window || run < sequential_run)
+            return {};
+        auto budget = size_t{nucl.config.mem_hint_mb} << 20;
+        if (nucl.product_bytes.load(std::memory_order_relaxed) > budget / 4 * 3)
+            window = std::max(window / 2, size_t{1});
+        else if (nucl.idle_workers.load(std::memory_order_relaxed))
+            window = std::min(window * 2, max_window);
+        window = std::min(window, max_window);
+        auto last = std::min(frame_idx + 1 + window, substrate->get_video_info().frame_count);
+        auto first = std::max(prefetched, frame_idx + 1);
+        for (auto idx = first; idx < last; ++idx)
+            post_maintain_task(nucl, substrate.get(), Construct{substrate, idx, nullptr, tick + (idx - frame_idx)});
+        prefetched = std::max(prefetched, last);
+        return {first, std::max(first, last)};
+    }
 
-class Output final : public Object, virtual public IOutput, public Shuttle {
   public:
     cat_ptr<Substrate> substrate;
 
     void get_frame(size_t frame_idx, ICallback* cb) noexcept final {
-        post_maintain_task(nucl, substrate, frame_idx, cb);
+        auto tick = nucl.tick.fetch_add(1, std::memory_order_relaxed);
+        post_maintain_task(nucl, substrate.get(), Construct{substrate, frame_idx, cb, tick, 0, lane()});
+        prefetch(frame_idx, tick);
+    }
+
+    void get_frame(size_t frame_idx, ICallback* cb, IRequest** request) noexcept final {
+        auto tick = nucl.tick.fetch_add(1, std::memory_order_relaxed);
+        auto request_id = nucl.request_serial.fetch_add(1, std::memory_order_relaxed);
+        post_maintain_task(nucl, substrate.get(), Construct{substrate, frame_idx, cb, tick, request_id, lane()});
+        create_instance<Request>(request, nucl, substrate, frame_idx, request_id, prefetch(frame_idx, tick));
+    }
+
+    void get_frame_blocking(size_t frame_idx, const IFrame** out) final {
+        static thread_local FrameWaiter waiter;
+        auto tick = nucl.tick.fetch_add(1, std::memory_order_relaxed);
+        // the waiter does not block, so it is handed the result on the maintainer
+        post_maintain_task(nucl, substrate.get(), Construct{substrate, frame_idx, &waiter, tick, 0, inline_lane});
+        prefetch(frame_idx, tick);
+        waiter.wait(out);
+    }
+
+    void set_prefetch(size_t max_window) noexcept final {
+        std::unique_lock lock(mutex);
+        this->max_window = max_window;
+    }
+
+    void set_inline_callbacks(bool enable) noexcept final {
+        inline_callbacks.store(enable, std::memory_order_relaxed);
+    }
+
+    void create_stream(size_t first, size_t last, size_t window, IOutputStream** out) noexcept final {
+        cond_check(first <= last && last <= substrate->get_video_info().frame_count, "stream range out of bounds");
+        cond_check(window, "stream window must not be zero");
+        create_instance<OutputStream>(out, nucl, substrate, first, last, window);
     }
 
     explicit Output(Nucleus& nucl, ISubstrate* substrate) noexcept
-        : Shuttle(nucl), substrate(&dynamic_cast<Substrate&>(*substrate)) {}
+        : Shuttle(nucl), max_window(size_t{std::max(nucl.config.thread_count, 1u)} * 2),
+          serial(nucl.output_serial.fetch_add(1, std::memory_order_relaxed)),
+          substrate(&dynamic_cast<Substrate&>(*substrate)) {}
 };
 
 void Nucleus::create_output(ISubstrate* substrate, IOutput** output) noexcept {
     create_instance<Output>(output, *this, substrate);
 }
+
+static uint64_t percentile(const uint64_t* histogram, uint64_t total, double q) noexcept {
+    if (!total)
+        return 0;
+    auto rank = static_cast<double>(total) * q;
+    uint64_t below = 0;
+    for (unsigned b = 0; b < WorkerCounters::histogram_size; ++b) {
+        if (below + histogram[b] >= rank) {
+            // interpolate linearly within [2^(b-1), 2^b)
+            double lo = b ? std::ldexp(1.0, static_cast<int>(b) - 1) : 0.0, hi = std::ldexp(1.0, static_cast<int>(b));
+            return static_cast<uint64_t>(lo + (hi - lo) * (rank - static_cast<double>(below)) /
+                                                  static_cast<double>(histogram[b]));
+        }
+        below += histogram[b];
+    }
+    return 0;
+}
+
+class Stats final : public Object, virtual public IStats {
+  public:
+    using Entries = std::vector<std::pair<cat_ptr<const ISubstrate>, SubstrateStats>>;
+    Entries entries;
+
+    explicit Stats(Entries entries) noexcept : entries(std::move(entries)) {}
+
+    size_t size() const noexcept final {
+        return entries.size();
+    }
+
+    const ISubstrate* get_substrate(size_t idx) const noexcept final {
+        cond_check(idx < entries.size(), "stats index out of range");
+        return entries[idx].first.get();
+    }
+
+    SubstrateStats get(size_t idx) const noexcept final {
+        cond_check(idx < entries.size(), "stats index out of range");
+        return entries[idx].second;
+    }
+};
+
+void Nucleus::collect_stats(IStats** out) noexcept {
+    Stats::Entries entries;
+    entries.reserve(substrates.size());
+    for (auto& [filter, isubstrate] : substrates) {
+        auto substrate = &dynamic_cast<Substrate&>(*isubstrate);
+        SubstrateStats s{};
+        uint64_t histogram[WorkerCounters::histogram_size]{};
+        for (size_t i = 0; i < substrate->worker_slots; ++i) {
+            auto& c = substrate->worker_counters[i];
+            s.frames_processed += c.frames.load(std::memory_order_relaxed);
+            s.process_ns += c.process_ns.load(std::memory_order_relaxed);
+            s.queue_wait_ns += c.wait_ns.load(std::memory_order_relaxed);
+            for (unsigned b = 0; b < WorkerCounters::histogram_size; ++b)
+                histogram[b] += c.histogram[b].load(std::memory_order_relaxed);
+        }
+        uint64_t total = 0;
+        for (auto count : histogram)
+            total += count;
+        s.process_ns_p50 = percentile(histogram, total, 0.5);
+        s.process_ns_p90 = percentile(histogram, total, 0.9);
+        s.process_ns_p99 = percentile(histogram, total, 0.99);
+        s.recomputes = substrate->recomputes.load(std::memory_order_relaxed);
+        s.bytes_produced = substrate->bytes_produced.load(std::memory_order_relaxed);
+        s.in_flight = substrate->in_flight.load(std::memory_order_relaxed);
+        entries.emplace_back(substrate, s);
+    }
+    create_instance<Stats>(out, std::move(entries));
+}
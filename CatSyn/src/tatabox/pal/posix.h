@@ -1,6 +1,16 @@
+#include <cstdio>
 #include <filesystem>
 #include <system_error>
 
+#include <cxxabi.h>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <link.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
 thread_local char fmt_buf[4096] __attribute__((weak));
@@ -17,32 +27,120 @@ inline void write_err(const char* msg, size_t size) noexcept {
     system_call_check(write(2, msg, size) == static_cast<ssize_t>(size));
 }
 
-template<typename T> void set_thread_priority(T& thread, int priority, bool allow_boost) noexcept {
-    // STUB
+inline void set_thread_priority(int priority, bool, bool realtime) noexcept {
+    if (realtime && priority > 0) {
+        sched_param param{sched_get_priority_min(SCHED_FIFO) + priority - 1};
+        if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0)
+            return;
+    }
+#ifdef __linux__
+    // nice values are per thread on Linux; raising priority needs CAP_SYS_NICE or a large enough RLIMIT_NICE
+    setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), -5 * priority);
+#endif
+}
+
+inline void set_thread_affinity(unsigned cpu) noexcept {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+inline std::vector<CpuInfo> get_cpu_topology() noexcept {
+    std::vector<CpuInfo> cpus;
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) != 0)
+        return cpus;
+    for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        if (CPU_ISSET(cpu, &set)) {
+            // sysfs links each cpu to its node as cpuN/nodeM; machines without NUMA have no such link
+            unsigned node = 0;
+            char path[64];
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u", cpu);
+            if (auto dir = opendir(path); dir) {
+                while (auto entry = readdir(dir))
+                    if (sscanf(entry->d_name, "node%u", &node) == 1)
+                        break;
+                closedir(dir);
+            }
+            cpus.push_back({cpu, node});
+        }
+    return cpus;
+}
+
+inline unsigned get_current_numa_node() noexcept {
+#ifdef __linux__
+    unsigned cpu, node;
+    if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0)
+        return node;
+#endif
+    return 0;
 }
 
+inline void prefetch_file(const std::filesystem::path& path) noexcept {
+    auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    close(fd);
+}
+
+// defined by crtbegin in every shared object, like __ImageBase on Windows
+extern "C" void* __dso_handle __attribute__((visibility("hidden")));
+
 class SharedLibrary {
+    void* mod;
+
+    [[noreturn]] static void throw_dl_error(std::errc code) {
+        auto msg = dlerror();
+        throw std::system_error(std::make_error_code(code), msg ? msg : "");
+    }
+
   public:
-    explicit SharedLibrary(const std::filesystem::path& path) {
-        // STUB
+    explicit SharedLibrary(const std::filesystem::path& path) : mod(dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL)) {
+        if (!mod)
+            throw_dl_error(std::errc::no_such_file_or_directory);
     }
 
     template<typename F> std::enable_if_t<std::is_function_v<F>, std::add_pointer_t<F>> get_function(const char* name) {
-        // STUB
-        return nullptr;
+        auto func = reinterpret_cast<std::add_pointer_t<F>>(dlsym(mod, name));
+        if (!func)
+            throw_dl_error(std::errc::function_not_supported);
+        return func;
     }
 
     ~SharedLibrary() {
-        // STUB
+        if (mod)
+            dlclose(mod);
     }
 
     static std::filesystem::path get_current_module_path() noexcept {
-        // STUB
-        return "";
+        Dl_info info;
+#ifdef RTLD_DL_LINKMAP
+        link_map* map;
+        if (!dladdr1(&__dso_handle, &info, reinterpret_cast<void**>(&map), RTLD_DL_LINKMAP))
+            return "";
+        // the main executable has an empty name in the link map and is reported by its argv[0] in dli_fname
+        if (!map->l_name[0]) {
+            std::error_code ec;
+            return std::filesystem::read_symlink("/proc/self/exe", ec);
+        }
+#else
+        if (!dladdr(&__dso_handle, &info))
+            return "";
+#endif
+        return info.dli_fname;
     }
 
     SharedLibrary(const SharedLibrary&) = delete;
     SharedLibrary(SharedLibrary&& other) noexcept {
-        // STUB
+        mod = other.mod;
+        other.mod = nullptr;
     }
 };
+
+inline void* runtime_dynamic_cast(void* src, const std::type_info& src_type, const std::type_info& dst_type) noexcept {
+    // -1: no hint about the relationship between the types
+    return abi::__dynamic_cast(src, static_cast<const abi::__class_type_info*>(&src_type),
+                               static_cast<const abi::__class_type_info*>(&dst_type), -1);
+}
@@ -36,12 +36,50 @@ inline void write_err(const char* msg, size_t size) noexcept {
     }
 }
 
-template<typename T> void set_thread_priority(T& thread, int priority, bool allow_boost) noexcept {
-    HANDLE hThread = thread.native_handle();
-    SetThreadPriority(hThread, priority);
+inline void set_thread_priority(int priority, bool allow_boost, bool realtime) noexcept {
+    HANDLE hThread = GetCurrentThread();
+    SetThreadPriority(hThread, realtime && priority > 0 ? THREAD_PRIORITY_TIME_CRITICAL : priority);
     SetThreadPriorityBoost(hThread, !allow_boost);
 }
 
+inline void set_thread_affinity(unsigned cpu) noexcept {
+    SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR{1} << cpu);
+}
+
+inline std::vector<CpuInfo> get_cpu_topology() noexcept {
+    // only the processor group of this process is considered
+    DWORD_PTR process_mask, system_mask;
+    std::vector<CpuInfo> cpus;
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask))
+        return cpus;
+    for (unsigned cpu = 0; cpu < sizeof(DWORD_PTR) * 8; ++cpu)
+        if (process_mask & (DWORD_PTR{1} << cpu)) {
+            UCHAR node;
+            cpus.push_back({cpu, GetNumaProcessorNode(static_cast<UCHAR>(cpu), &node) && node != 0xff ? node : 0u});
+        }
+    return cpus;
+}
+
+inline unsigned get_current_numa_node() noexcept {
+    PROCESSOR_NUMBER pn;
+    GetCurrentProcessorNumberEx(&pn);
+    USHORT node;
+    return GetNumaProcessorNodeEx(&pn, &node) && node != 0xffff ? node : 0u;
+}
+
+inline void prefetch_file(const std::filesystem::path& path) noexcept {
+    auto file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return;
+    // there is no readahead hint for plain files; reading through the cache warms it just as well
+    thread_local char buf[65536];
+    DWORD read;
+    while (ReadFile(file, buf, sizeof(buf), &read, nullptr) && read)
+        ;
+    CloseHandle(file);
+}
+
 extern "C" IMAGE_DOS_HEADER __ImageBase;
 
 class SharedLibrary {
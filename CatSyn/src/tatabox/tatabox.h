@@ -1,8 +1,10 @@
 #pragma once
 
 #include <exception>
+#include <filesystem>
 #include <type_traits>
 #include <thread>
+#include <vector>
 
 #include <fmt/format.h>
 
@@ -63,7 +65,21 @@ inline void system_call_check(bool cond) {
         throw_system_error();
 }
 
-template<typename T> void set_thread_priority(T& thread, int priority, bool allow_boost = true) noexcept;
+// all of these act on the calling thread; failures (e.g. missing privileges) are ignored
+inline void set_thread_priority(int priority, bool allow_boost = true, bool realtime = false) noexcept;
+inline void set_thread_affinity(unsigned cpu) noexcept;
+
+struct CpuInfo {
+    unsigned cpu;
+    unsigned node;
+};
+
+// logical processors this process may run on, ordered by index
+inline std::vector<CpuInfo> get_cpu_topology() noexcept;
+inline unsigned get_current_numa_node() noexcept;
+
+// warm the OS file cache for a file that is about to be loaded
+inline void prefetch_file(const std::filesystem::path& path) noexcept;
 
 class SharedLibrary;
 
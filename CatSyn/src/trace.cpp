@@ -0,0 +1,93 @@
+#include <chrono>
+
+#include <catimpl.h>
+
+static std::atomic_size_t tracer_serial;
+
+static thread_local struct {
+    size_t serial;
+    void* ring;
+} local_ring;
+
+Tracer::Tracer() noexcept : serial(tracer_serial.fetch_add(1, std::memory_order_relaxed) + 1) {}
+
+Tracer::Ring& Tracer::local() noexcept {
+    if (local_ring.serial == serial)
+        return *static_cast<Ring*>(local_ring.ring);
+    auto ring = std::make_unique<Ring>();
+    ring->records.reset(new TraceRecord[ring_size]);
+    auto p = ring.get();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        p->name = fmt::format("thread {}", rings.size());
+        rings.emplace_back(std::move(ring));
+    }
+    local_ring = {serial, p};
+    return *p;
+}
+
+void Tracer::name_thread(std::string name) noexcept {
+    auto& ring = local();
+    std::lock_guard<std::mutex> lock(mutex);
+    ring.name = std::move(name);
+}
+
+void Tracer::record(TraceEvent event, size_t substrate, size_t frame_idx, const void* inst) noexcept {
+    auto& ring = local();
+    auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch())
+                    .count();
+    auto w = ring.written.load(std::memory_order_relaxed);
+    ring.records[w % ring_size] = {static_cast<uint64_t>(time), substrate, frame_idx, inst, event};
+    ring.written.store(w + 1, std::memory_order_release);
+}
+
+std::string Tracer::export_json() noexcept {
+    static constexpr const char* names[] = {"construct", "ready", "dequeue", "process", "process", "callback"};
+    std::string out = R"({"displayTimeUnit":"ns","traceEvents":[)";
+    auto it = std::back_inserter(out);
+    bool first = true;
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t tid = 0; tid < rings.size(); ++tid) {
+        auto& ring = *rings[tid];
+        fmt::format_to(it, R"({}{{"ph":"M","name":"thread_name","pid":1,"tid":{},"args":{{"name":"{}"}}}})",
+                       first ? "" : ",", tid, ring.name);
+        first = false;
+        auto end = ring.written.load(std::memory_order_acquire);
+        auto begin = end > ring_size ? end - ring_size : 0;
+        std::vector<TraceRecord> copy;
+        copy.reserve(end - begin);
+        for (auto i = begin; i < end; ++i)
+            copy.push_back(ring.records[i % ring_size]);
+        // records the owner overwrote while they were being copied are torn
+        auto overwritten = ring.written.load(std::memory_order_acquire);
+        auto skip = overwritten > begin + ring_size ? std::min(overwritten - begin - ring_size, copy.size()) : 0;
+        for (auto r = copy.begin() + static_cast<ptrdiff_t>(skip); r != copy.end(); ++r) {
+            const char* ph;
+            switch (r->event) {
+            case TraceEvent::ProcessStart:
+                ph = R"("ph":"B")";
+                break;
+            case TraceEvent::ProcessEnd:
+                ph = R"("ph":"E")";
+                break;
+            default:
+                ph = R"("ph":"i","s":"t")";
+                break;
+            }
+            fmt::format_to(it,
+                           R"(,{{{},"name":"{} #{}","cat":"{}","pid":1,"tid":{},"ts":{}.{:03},)"
+                           R"("args":{{"substrate":{},"frame":{},"instance":"{}"}}}})",
+                           ph, names[static_cast<unsigned>(r->event)], r->substrate,
+                           names[static_cast<unsigned>(r->event)], tid, r->time / 1000, r->time % 1000,
+                           r->substrate, r->frame_idx, r->inst);
+        }
+    }
+    out += "]}";
+    return out;
+}
+
+void Nucleus::export_trace(IBytes** out) noexcept {
+    auto json = tracer.export_json();
+    create_bytes(json.data(), json.size(), out);
+}
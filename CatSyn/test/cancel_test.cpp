@@ -0,0 +1,328 @@
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <cathelper.h>
+#include <catsyn_1.h>
+#include <tatabox.h>
+
+using namespace catsyn;
+
+using namespace std::chrono_literals;
+
+// frames processed and frame data handed out and reclaimed, by one filter
+struct Probe {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::multiset<size_t> processed;
+    size_t created = 0;
+    size_t dropped = 0;
+    // process_frame waits until the gate is opened
+    bool open = true;
+
+    void enter(size_t frame_idx) {
+        std::unique_lock lock(mutex);
+        processed.insert(frame_idx);
+        cv.notify_all();
+        cv.wait(lock, [&]() { return open; });
+    }
+
+    // waits for a frame to be processed; false on timeout
+    bool wait_entered() {
+        std::unique_lock lock(mutex);
+        return cv.wait_for(lock, 10s, [&]() { return !processed.empty(); });
+    }
+
+    void set_open(bool value) {
+        std::lock_guard lock(mutex);
+        open = value;
+        cv.notify_all();
+    }
+};
+
+struct TestFilter : virtual public IFilter {
+    INucleus* nucl;
+    Probe& probe;
+
+    struct Data : FrameData {
+        size_t frame_idx;
+        std::vector<FrameSource> sources;
+    };
+
+    TestFilter(INucleus* nucl, Probe& probe) noexcept : nucl(nucl), probe(probe) {}
+
+    FilterFlags get_filter_flags() const noexcept override {
+        return ffNormal;
+    }
+
+    VideoInfo get_video_info() const noexcept override {
+        return {{make_frame_format(ColorFamily::Gray, SampleType::Integer, 8, 0, 0), 64, 4}, {1, 1}, 64};
+    }
+
+    void drop_frame_data(FrameData* frame_data) const noexcept override {
+        std::lock_guard lock(probe.mutex);
+        ++probe.dropped;
+        delete static_cast<Data*>(frame_data);
+    }
+
+    void drop() noexcept override {
+        delete this;
+    }
+
+    Data* make_data(size_t frame_idx) const noexcept {
+        std::lock_guard lock(probe.mutex);
+        ++probe.created;
+        auto data = new Data;
+        data->frame_idx = frame_idx;
+        return data;
+    }
+
+    const IFrame* make_frame(uint8_t value) const {
+        IFrame* frame;
+        nucl->get_factory()->create_frame(get_video_info().frame_info, nullptr, nullptr, nullptr, &frame);
+        static_cast<uint8_t*>(frame->get_plane_mut(0)->data())[0] = value;
+        return frame;
+    }
+};
+
+// frame i is filled with i
+struct Source final : TestFilter {
+    using TestFilter::TestFilter;
+
+    void get_frame_data(size_t frame_idx, FrameData** frame_data) const noexcept override {
+        auto data = make_data(frame_idx);
+        data->dependencies = nullptr;
+        data->dependency_count = 0;
+        *frame_data = data;
+    }
+
+    void process_frame(const IFrame* const*, FrameData** frame_data, const IFrame** out) const override {
+        auto frame_idx = static_cast<Data*>(*frame_data)->frame_idx;
+        probe.enter(frame_idx);
+        *out = make_frame(static_cast<uint8_t>(frame_idx));
+    }
+};
+
+// frame i is the sum of the frames i and i + 1 of src
+struct Pair final : TestFilter {
+    const ISubstrate* src;
+
+    Pair(INucleus* nucl, Probe& probe, const ISubstrate* src) noexcept : TestFilter(nucl, probe), src(src) {}
+
+    void get_frame_data(size_t frame_idx, FrameData** frame_data) const noexcept override {
+        auto data = make_data(frame_idx);
+        data->sources = {{src, frame_idx}, {src, std::min(frame_idx + 1, size_t{63})}};
+        data->dependencies = data->sources.data();
+        data->dependency_count = data->sources.size();
+        *frame_data = data;
+    }
+
+    void process_frame(const IFrame* const* input_frames, FrameData** frame_data, const IFrame** out) const override {
+        probe.enter(static_cast<Data*>(*frame_data)->frame_idx);
+        auto value = [&](size_t idx) {
+            return static_cast<const uint8_t*>(input_frames[idx]->get_plane(0)->data())[0];
+        };
+        *out = make_frame(static_cast<uint8_t>(value(0) + value(1)));
+    }
+};
+
+// Callbacks of the requests of one test. Each callback must be invoked exactly once.
+struct Deliveries {
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t delivered = 0;
+    size_t cancelled = 0;
+    size_t failed = 0;
+
+    cat_ptr<ICallback> callback() {
+        return wrap_callback([this](const IFrame* frame, std::exception_ptr exc) {
+            std::lock_guard lock(mutex);
+            ++delivered;
+            if (exc)
+                try {
+                    std::rethrow_exception(exc);
+                } catch (FrameCancelled&) {
+                    ++cancelled;
+                } catch (...) {
+                    ++failed;
+                }
+            else
+                cond_check(frame, "callback invoked without frame nor exception");
+            cv.notify_all();
+        });
+    }
+
+    bool wait(size_t count) {
+        std::unique_lock lock(mutex);
+        return cv.wait_for(lock, 10s, [&]() { return delivered >= count; });
+    }
+};
+
+// Two shards and a single worker, so that the frames queued behind a gated one stay queued.
+struct Graph {
+    cat_ptr<INucleus> nucl;
+    Probe source_probe, pair_probe;
+    const ISubstrate* source;
+    const ISubstrate* pair;
+    cat_ptr<IOutput> source_output, pair_output;
+
+    Graph() {
+        create_nucleus(nucl.put());
+        auto& nucl1 = dynamic_cast<INucleus1&>(*nucl);
+        NucleusConfig1 config;
+        nucl1.get_config(&config);
+        config.thread_count = 1;
+        config.maintainer_count = 2;
+        nucl1.set_config(config);
+        source = nucl->register_filter(wrap_cat_ptr(new Source(nucl.get(), source_probe)).get());
+        pair = nucl->register_filter(wrap_cat_ptr(new Pair(nucl.get(), pair_probe, source)).get());
+        nucl->react();
+        nucl->create_output(const_cast<ISubstrate*>(source), source_output.put());
+        nucl->create_output(const_cast<ISubstrate*>(pair), pair_output.put());
+        output1(source_output).set_prefetch(0);
+        output1(pair_output).set_prefetch(0);
+    }
+
+    static IOutput1& output1(const cat_ptr<IOutput>& output) {
+        return dynamic_cast<IOutput1&>(*output);
+    }
+
+    // waits until no frame is in flight, then a little longer for late callbacks; false on timeout
+    bool settle() {
+        for (auto deadline = std::chrono::steady_clock::now() + 10s; std::chrono::steady_clock::now() < deadline;) {
+            cat_ptr<IStats> stats;
+            dynamic_cast<INucleus1&>(*nucl).collect_stats(stats.put());
+            size_t in_flight = 0;
+            for (size_t i = 0; i < stats->size(); ++i)
+                in_flight += stats->get(i).in_flight;
+            if (!in_flight) {
+                std::this_thread::sleep_for(50ms);
+                return true;
+            }
+            std::this_thread::sleep_for(1ms);
+        }
+        return false;
+    }
+
+    // The inputs of a cancelled frame are unlinked on their own shard after its callback is posted, and those already
+    // queued for the workers are only flagged, so nothing observable tells when it is done.
+    static void wait_unlinked() {
+        std::this_thread::sleep_for(50ms);
+    }
+
+    // every frame data handed out has been reclaimed through drop_frame_data
+    bool reclaimed() {
+        for (auto probe : {&source_probe, &pair_probe}) {
+            std::lock_guard lock(probe->mutex);
+            if (probe->created != probe->dropped)
+                return false;
+        }
+        return true;
+    }
+};
+
+// Cancelling a frame waiting for its inputs unlinks it from them, on the shard owning the inputs, and the input
+// nothing else needs is withdrawn before a worker gets to it.
+static void test_cancel_unlinks_inputs() {
+    Graph graph;
+    Deliveries deliveries;
+    graph.source_probe.set_open(false);
+    cat_ptr<IRequest> request;
+    Graph::output1(graph.pair_output).get_frame(10, deliveries.callback().get(), request.put());
+    cond_check(graph.source_probe.wait_entered(), "input frame not processed");
+    request->cancel();
+    cond_check(deliveries.wait(1), "cancelled request not called back");
+    Graph::wait_unlinked();
+    graph.source_probe.set_open(true);
+    cond_check(graph.settle(), "frames still in flight after cancelling");
+    cond_check(graph.reclaimed(), "frame data not reclaimed");
+    std::lock_guard lock(graph.source_probe.mutex);
+    cond_check(graph.source_probe.processed.size() == 1, "withdrawn input frame processed");
+    cond_check(graph.pair_probe.processed.empty(), "cancelled frame processed");
+    cond_check(deliveries.delivered == 1 && deliveries.cancelled == 1, "cancelled request not reported as such");
+}
+
+// A request cancelled while its frame is being processed is called back right away, and never again once the frame
+// is produced.
+static void test_cancel_in_flight() {
+    Graph graph;
+    Deliveries deliveries;
+    graph.source_probe.set_open(false);
+    cat_ptr<IRequest> request;
+    Graph::output1(graph.source_output).get_frame(5, deliveries.callback().get(), request.put());
+    cond_check(graph.source_probe.wait_entered(), "frame not processed");
+    request->cancel();
+    request->cancel();
+    cond_check(deliveries.wait(1), "request cancelled in flight not called back");
+    graph.source_probe.set_open(true);
+    cond_check(graph.settle(), "frames still in flight after cancelling");
+    cond_check(graph.reclaimed(), "frame data not reclaimed");
+    std::lock_guard lock(deliveries.mutex);
+    cond_check(deliveries.delivered == 1 && deliveries.cancelled == 1, "callback invoked after cancelling");
+}
+
+// Cancelled requests are called back exactly once, with FrameCancelled, and the frames nothing else needs are dropped,
+// while a request for a frame they share is still delivered.
+static void test_no_callback_after_cancel() {
+    Graph graph;
+    Deliveries deliveries, kept;
+    graph.source_probe.set_open(false);
+    std::vector<cat_ptr<IRequest>> requests(20);
+    for (size_t i = 0; i < requests.size(); ++i)
+        Graph::output1(graph.pair_output).get_frame(i * 2, deliveries.callback().get(), requests[i].put());
+    cat_ptr<IRequest> shared;
+    Graph::output1(graph.source_output).get_frame(7, kept.callback().get(), shared.put());
+    cond_check(graph.source_probe.wait_entered(), "input frame not processed");
+    for (auto& request : requests)
+        request->cancel();
+    cond_check(deliveries.wait(requests.size()), "cancelled requests not called back");
+    Graph::wait_unlinked();
+    graph.source_probe.set_open(true);
+    cond_check(kept.wait(1), "request sharing an input with cancelled ones not delivered");
+    cond_check(graph.settle(), "frames still in flight after cancelling");
+    cond_check(graph.reclaimed(), "frame data not reclaimed");
+    {
+        std::lock_guard lock(deliveries.mutex);
+        cond_check(deliveries.delivered == requests.size() && deliveries.cancelled == requests.size(),
+                   "callback invoked after cancelling");
+    }
+    {
+        std::lock_guard lock(kept.mutex);
+        cond_check(kept.delivered == 1 && !kept.cancelled && !kept.failed, "kept request not delivered once");
+    }
+    std::lock_guard lock(graph.source_probe.mutex);
+    // the frame being processed when cancelling, and the one still requested
+    cond_check(graph.source_probe.processed.size() <= 2 && graph.source_probe.processed.count(7) == 1,
+               "withdrawn input frames processed");
+    cond_check(graph.pair_probe.processed.empty(), "cancelled frames processed");
+}
+
+// Frames prefetched after a sequence of requests are dropped along with the requests.
+static void test_cancel_drops_prefetched() {
+    Graph graph;
+    Deliveries deliveries;
+    Graph::output1(graph.pair_output).set_prefetch(8);
+    graph.source_probe.set_open(false);
+    std::vector<cat_ptr<IRequest>> requests(4);
+    for (size_t i = 0; i < requests.size(); ++i)
+        Graph::output1(graph.pair_output).get_frame(i, deliveries.callback().get(), requests[i].put());
+    cond_check(graph.source_probe.wait_entered(), "input frame not processed");
+    for (auto& request : requests)
+        request->cancel();
+    cond_check(deliveries.wait(requests.size()), "cancelled requests not called back");
+    graph.source_probe.set_open(true);
+    cond_check(graph.settle(), "frames still in flight after cancelling");
+    cond_check(graph.reclaimed(), "frame data not reclaimed");
+    std::lock_guard lock(graph.pair_probe.mutex);
+    cond_check(graph.pair_probe.processed.empty(), "prefetched frames processed after cancelling");
+}
+
+int main() {
+    test_cancel_unlinks_inputs();
+    test_cancel_in_flight();
+    test_no_callback_after_cancel();
+    test_cancel_drops_prefetched();
+}
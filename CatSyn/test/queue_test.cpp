@@ -0,0 +1,126 @@
+#include <chrono>
+#include <random>
+#include <thread>
+#include <unordered_map>
+
+#include <flatmap.h>
+#include <queue.h>
+#include <tatabox.h>
+
+static void test_stealing_queue_order() {
+    StealingQueue<int> queue;
+    queue.resize(2);
+    for (int v : {3, 9, 1, 7})
+        queue.push(v, 0);
+    for (int expected : {9, 7, 3, 1})
+        cond_check(queue.pop<false>(0) == expected, "lane not popped in priority order");
+    cond_check(!queue.pop<false>(0), "pop from an empty queue returned a value");
+}
+
+static void test_stealing_queue_steal() {
+    StealingQueue<int> queue;
+    queue.resize(3);
+    queue.push(5, 2);
+    queue.push(4, 1);
+    // the own lane comes first, then the others in turn
+    queue.push(1, 0);
+    cond_check(queue.pop<false>(0) == 1, "own lane not preferred");
+    cond_check(queue.pop<false>(0) == 4, "next lane not stolen from");
+    cond_check(queue.pop<false>(0) == 5, "last lane not stolen from");
+    cond_check(!queue.pop<false>(0), "stolen value returned twice");
+}
+
+static void test_stealing_queue_sleep() {
+    StealingQueue<int> queue;
+    queue.resize(2);
+    std::atomic_int sum{0};
+    std::atomic_int received{0};
+    std::thread consumer([&]() {
+        try {
+            queue.stream(1, [&](int v) {
+                sum.fetch_add(v);
+                received.fetch_add(1);
+            });
+        } catch (StopRequested&) {
+        }
+    });
+    // the consumer is asleep by now, and each push to the other lane has to wake it
+    for (int i = 1; i <= 100; ++i) {
+        std::this_thread::sleep_for(std::chrono::microseconds(i % 10 ? 0 : 1000));
+        queue.push(i, 0);
+    }
+    for (auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+         received.load() < 100 && std::chrono::steady_clock::now() < deadline;)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    cond_check(received.load() == 100 && sum.load() == 5050, "sleeping consumer missed a push");
+    queue.request_stop();
+    consumer.join();
+}
+
+// every key is its own hash, so that the home slots can be chosen
+struct IdentityHash {
+    size_t operator()(size_t key) const noexcept {
+        return key;
+    }
+};
+
+// the home slot of key in a table of 16 slots, as FlatMap computes it
+static size_t home_of(size_t key) {
+    return static_cast<size_t>((key * UINT64_C(0x9E3779B97F4A7C15)) >> 60);
+}
+
+static void test_flat_map_erase_wraparound() {
+    // a cluster starting in the last slot spills over into the first ones
+    std::vector<size_t> last, first;
+    for (size_t key = 1; last.size() < 3 || first.size() < 2; ++key)
+        if (home_of(key) == 15 && last.size() < 3)
+            last.push_back(key);
+        else if (home_of(key) == 0 && first.size() < 2)
+            first.push_back(key);
+    FlatMap<size_t, size_t, IdentityHash> map;
+    for (auto key : last)
+        map.try_emplace(key, key * 2);
+    for (auto key : first)
+        map.try_emplace(key, key * 2);
+    cond_check(map.size() == 5, "keys lost on insertion");
+    // erasing in the last slot has to shift back entries from across the end of the table
+    for (auto erased : {last[0], first[0], last[2]}) {
+        cond_check(map.erase(erased), "present key not erased");
+        cond_check(!map.find(erased), "erased key still found");
+        for (auto key : last)
+            if (key != erased && map.find(key))
+                cond_check(*map.find(key) == key * 2, "value moved to the wrong key");
+        for (auto key : first)
+            if (key != erased && map.find(key))
+                cond_check(*map.find(key) == key * 2, "value moved to the wrong key");
+    }
+    cond_check(map.find(last[1]) && map.find(first[1]), "key lost by erasing another");
+    cond_check(map.size() == 2, "size not updated on erase");
+}
+
+static void test_flat_map_random() {
+    // a small key space keeps the table crowded, so clusters wrap around and erasures shift entries often
+    FlatMap<size_t, size_t, IdentityHash> map;
+    std::unordered_map<size_t, size_t> reference;
+    std::mt19937_64 rng(42);
+    for (int i = 0; i < 200000; ++i) {
+        auto key = rng() % 48;
+        if (rng() % 2) {
+            auto [value, inserted] = map.try_emplace(key, key + i);
+            auto [it, ref_inserted] = reference.try_emplace(key, key + i);
+            cond_check(inserted == ref_inserted && *value == it->second, "insertion differs from reference");
+        } else
+            cond_check(map.erase(key) == !!reference.erase(key), "erasure differs from reference");
+        cond_check(map.size() == reference.size(), "size differs from reference");
+    }
+    for (auto [key, value] : reference)
+        cond_check(map.find(key) && *map.find(key) == value, "lookup differs from reference");
+}
+
+int main() {
+    test_stealing_queue_order();
+    test_stealing_queue_steal();
+    test_stealing_queue_sleep();
+    test_flat_map_erase_wraparound();
+    test_flat_map_random();
+}
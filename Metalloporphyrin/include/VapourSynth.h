@@ -181,6 +181,7 @@ typedef void (*VSFilterFree)(void* instanceData, VSCore* core, const VSAPI* vsap
 typedef void (*VSFrameDoneCallback)(void* userData, const VSFrameRef* f, int n, VSNodeRef*, const char* errorMsg);
 typedef void (*VSMessageHandler)(int msgType, const char* msg, void* userData);
 typedef void (*VSMessageHandlerFree)(void* userData);
+typedef void (*VSBandFunc)(void* userData, int band);
 
 struct VSAPI {
     VSCore* (*createCore)(int threads) noexcept;
@@ -266,6 +267,11 @@ struct VSAPI {
     int (*addMessageHandler)(VSMessageHandler handler, VSMessageHandlerFree free, void* userData) noexcept;
     int (*removeMessageHandler)(int id) noexcept;
     void (*getCoreInfo2)(VSCore* core, VSCoreInfo* info) noexcept;
+
+    // Metalloporphyrin extension
+    VSFrameRef* (*newVideoFrameView)(const VSFrameRef* src, const VSFormat* format, int width, int height,
+                                     const int64_t* offsets, const int* strides, VSCore* core) noexcept;
+    void (*runBands)(int count, VSBandFunc func, void* userData, VSCore* core) noexcept;
 };
 
 VS_API(const VSAPI*) getVapourSynthAPI(int version) noexcept;
@@ -78,6 +78,8 @@ VSAPI api{
     addMessageHandler,
     removeMessageHandler,
     getCoreInfo2,
+    newVideoFrameView,
+    runBands,
 };
 
 VS_API(const VSAPI*) getVapourSynthAPI(int version) noexcept {
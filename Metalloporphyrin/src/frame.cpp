@@ -148,6 +148,31 @@ VSFrameRef* newVideoFrame2(const VSFormat* format, int width, int height, const
     return frame_ref;
 }
 
+VSFrameRef* newVideoFrameView(const VSFrameRef* src, const VSFormat* format, int width, int height,
+                              const int64_t* offsets, const int* strides, VSCore*) noexcept {
+    catsyn::FrameInfo fi{
+        ff_vs_to_cs(format),
+        static_cast<unsigned>(width),
+        static_cast<unsigned>(height),
+    };
+    auto& factory = dynamic_cast<catsyn::IFactory1&>(*core->nucl->get_factory());
+    auto count = catsyn::num_planes(fi.format);
+    cond_check(count <= catsyn::num_planes(src->frame->get_frame_info().format), "view has more planes than source");
+    std::array<catsyn::cat_ptr<catsyn::IBytes>, 3> views;
+    std::array<const catsyn::IBytes*, 3> agb;
+    std::array<size_t, 3> view_strides;
+    for (unsigned i = 0; i < count; ++i) {
+        auto stride = static_cast<size_t>(strides[i]);
+        auto len = stride * (catsyn::plane_height(fi, i) - 1) + catsyn::width_bytes(fi, i);
+        factory.create_bytes_view(src->frame->get_plane(i), static_cast<size_t>(offsets[i]), len, views[i].put());
+        agb[i] = views[i].get();
+        view_strides[i] = stride;
+    }
+    auto frame_ref = new VSFrameRef;
+    factory.create_frame(fi, agb.data(), view_strides.data(), src->frame->get_frame_props(), frame_ref->frame.put());
+    return frame_ref;
+}
+
 VSFrameRef* copyFrame(const VSFrameRef* f, VSCore*) noexcept {
     return new VSFrameRef{f->frame.clone()};
 }
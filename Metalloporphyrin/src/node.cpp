@@ -1,5 +1,4 @@
 #include <mutex>
-#include <variant>
 
 #include <boost/container/flat_map.hpp>
 #include <boost/container/flat_set.hpp>
@@ -42,24 +41,17 @@ const VSFrameRef* getFrame(int n, VSNodeRef* node, char* errorMsg, int bufSize)
     }
     if (!node->output)
         core->nucl->create_output(node->substrate.get(), node->output.put());
-    std::condition_variable cv;
-    std::mutex m;
-    const VSFrameRef* frame_ref = nullptr;
-    node->output->get_frame(n, catsyn::wrap_callback([&](const catsyn::IFrame* frame, std::exception_ptr exc) {
-                                   if (exc)
-                                       try {
-                                           std::rethrow_exception(exc);
-                                       } catch (std::exception& exc) {
-                                           strcpy_s(errorMsg, bufSize, exc.what());
-                                       }
-                                   else
-                                       frame_ref = new VSFrameRef{frame};
-                                   std::lock_guard<std::mutex> guard(m);
-                                   cv.notify_one();
-                               }).get());
-    std::unique_lock<std::mutex> guard(m);
-    cv.wait(guard);
-    return frame_ref;
+    const catsyn::IFrame* frame;
+    try {
+        dynamic_cast<catsyn::IOutput1&>(*node->output).get_frame_blocking(n, &frame);
+    } catch (std::exception& exc) {
+        strcpy_s(errorMsg, bufSize, exc.what());
+        return nullptr;
+    } catch (...) {
+        strcpy_s(errorMsg, bufSize, "unknown exception");
+        return nullptr;
+    }
+    return new VSFrameRef{catsyn::cat_ptr<const catsyn::IFrame>(frame, false)};
 }
 
 struct FrameSourceCompare {
@@ -76,22 +68,34 @@ struct VSFrameContext : catsyn::FrameData {
     typedef boost::container::small_flat_map<catsyn::FrameSource, const catsyn::IFrame*, 10, FrameSourceCompare>
         input_map;
     size_t frame_idx;
-    std::variant<request_container, input_map> frames;
+    // every frame requested so far, in all rounds; the dependencies of the frame data
+    request_container requests;
+    boost::container::small_vector<VSNodeRef*, 10> request_nodes;
+    input_map inputs;
+    // requests whose frames have been delivered
+    size_t delivered;
+    // the request announced by the current arFrameReady or arAllFramesReady call
+    size_t completed;
     const char* error;
     void* vs_frame_data;
-    explicit VSFrameContext(size_t frame_idx) noexcept : frame_idx(frame_idx), error(nullptr), vs_frame_data(nullptr) {}
+    explicit VSFrameContext(size_t frame_idx) noexcept
+        : frame_idx(frame_idx), delivered(0), completed(0), error(nullptr), vs_frame_data(nullptr) {}
 };
 
 const VSFrameRef* getFrameFilter(int n, VSNodeRef* node, VSFrameContext* frameCtx) noexcept {
-    auto& input_frames = std::get<VSFrameContext::input_map>(frameCtx->frames);
+    auto& input_frames = frameCtx->inputs;
     auto it = input_frames.find(catsyn::FrameSource{node->substrate.get(), static_cast<size_t>(n)});
     cond_check(it != input_frames.end(), "the filter attempts to get a frame that has not been requested");
+    if (!it->second) {
+        frameCtx->error = "the filter attempts to get a frame that has been released early";
+        return nullptr;
+    }
     return new VSFrameRef{it->second};
 }
 
 void requestFrameFilter(int n, VSNodeRef* node, VSFrameContext* frameCtx) noexcept {
-    std::get<VSFrameContext::request_container>(frameCtx->frames)
-        .push_back(catsyn::FrameSource{node->substrate.get(), static_cast<size_t>(n)});
+    frameCtx->requests.push_back(catsyn::FrameSource{node->substrate.get(), static_cast<size_t>(n)});
+    frameCtx->request_nodes.push_back(node);
 }
 
 void setFilterError(const char* errorMessage, VSFrameContext* frameCtx) noexcept {
@@ -118,6 +122,17 @@ struct VSFilter final : Object, virtual catsyn::IFilter1 {
     mutable void* instanceData;
     mutable bool is_source_filter;
     std::atomic_uint init_atomic;
+    // fmUnordered and fmSerial filters never see concurrent getFrame calls, including arInitial and arError ones. As
+    // single-threaded substrates, the serial executor keeps their process_frame calls apart, so all their calls are
+    // made from there. This costs a frame with requests one more trip through the work queue, as arInitial cannot run
+    // on the maintainer. fmSerial filters also see one frame at a time, from arInitial to arAllFramesReady, like
+    // VapourSynth does, with the ready frames started in frame order.
+    bool exclusive;
+    // arError calls of exclusive filters, made by the next process_frame
+    mutable std::mutex drops_mutex;
+    mutable std::vector<VSFrameContext*> drops;
+
+    void flush_drops() const noexcept;
 
     ~VSFilter() final;
 
@@ -158,8 +173,17 @@ static const class ParallelBlacklist {
 
 void createFilter(const VSMap* in, VSMap* out, const char* name, VSFilterInit init, VSFilterGetFrame getFrame,
                   VSFilterFree freer, int filterMode, int flags, void* instanceData, VSCore*) noexcept {
-    cond_check(filterMode < fmSerial, "fmSerial is not supported");
-    cond_check(flags <= nfMakeLinear && (flags & nfIsCache) == 0, "nfIsCache is not supported");
+    cond_check(filterMode <= fmSerial, "invalid filter mode");
+    cond_check(flags <= (nfNoCache | nfIsCache | nfMakeLinear), "invalid node flags");
+    if ((flags & nfIsCache) && !(flags & nfMakeLinear))
+        // the nucleus caches the frames of every substrate, so a cache node is its input clip itself
+        if (auto clip = in->table->get(in->table->find("clip"), nullptr);
+            dynamic_cast<const catsyn::IFilter*>(clip) || dynamic_cast<const catsyn::ISubstrate*>(clip)) {
+            if (freer)
+                freer(instanceData, core.get(), &api);
+            out->get_mut()->set(out->table->find("clip"), clip, "clip");
+            return;
+        }
     auto plugin = plugin_invoke_stack.top();
     std::unique_ptr<VSNodeRef> node(new VSNodeRef);
     init(const_cast<VSMap*>(in), out, &instanceData, reinterpret_cast<VSNode*>(node.get()), core.get(), &api);
@@ -169,7 +193,9 @@ void createFilter(const VSMap* in, VSMap* out, const char* name, VSFilterInit in
         (flags & nfMakeLinear ? catsyn::ffMakeLinear : catsyn::ffNormal) |
         (filterMode == fmParallel && !parallel_blacklist.is_blacklisted(plugin->enzyme->get_identifier())
              ? catsyn::ffNormal
-             : catsyn::ffSingleThreaded));
+             : catsyn::ffSingleThreaded) |
+        (filterMode == fmSerial ? catsyn::ffFrameOrdered | catsyn::ffSerialRounds : 0));
+    filter->exclusive = filterMode >= fmUnordered;
     filter->getFrame = getFrame;
     filter->freer = freer;
     filter->instanceData = instanceData;
@@ -178,6 +204,7 @@ void createFilter(const VSMap* in, VSMap* out, const char* name, VSFilterInit in
 }
 
 VSFilter::~VSFilter() {
+    flush_drops();
     if (freer)
         freer(instanceData, core.get(), &api);
 }
@@ -196,16 +223,16 @@ catsyn::VideoInfo VSFilter::get_video_info() const noexcept {
 
 void VSFilter::get_frame_data(size_t frame_idx, catsyn::FrameData** frame_data) const noexcept {
     auto ctx = std::make_unique<VSFrameContext>(frame_idx);
-    if (is_source_filter)
+    // exclusive filters get arInitial from the first round of process_frame instead, off the maintainer
+    if (is_source_filter || exclusive)
         ctx->dependency_count = 0;
     else {
-        auto& frames = ctx->frames.emplace<VSFrameContext::request_container>();
         is_source_filter = !!getFrame(static_cast<int>(frame_idx), arInitial, &instanceData, &ctx->vs_frame_data,
                                       ctx.get(), core.get(), &api);
         if (auto err = ctx->error; err)
             throw_filter_error(err);
-        ctx->dependencies = frames.data();
-        ctx->dependency_count = frames.size();
+        ctx->dependencies = ctx->requests.data();
+        ctx->dependency_count = ctx->requests.size();
     }
     *frame_data = ctx.release();
 }
@@ -214,21 +241,76 @@ void VSFilter::process_frame(const catsyn::IFrame* const* input_frames, catsyn::
                              const catsyn::IFrame** out) const {
     auto ctx = std::unique_ptr<VSFrameContext>(static_cast<VSFrameContext*>(*frame_data));
     *frame_data = nullptr;
-    VSFrameContext::input_map inputs;
+    ctx->inputs.clear();
+    // inputs released early come back as null and stay marked as such, unless requested again in a later round
     for (size_t i = 0; i < ctx->dependency_count; ++i)
-        inputs.emplace(ctx->dependencies[i], input_frames[i]);
-    ctx->frames = std::move(inputs);
-    auto frame_ref = std::unique_ptr<VSFrameRef>(const_cast<VSFrameRef*>(
-        getFrame(static_cast<int>(ctx->frame_idx), is_source_filter ? arInitial : arAllFramesReady, &instanceData,
-                 &ctx->vs_frame_data, ctx.get(), core.get(), &api)));
-    if (auto err = ctx->error; err)
-        throw_filter_error(err);
+        if (auto [it, fresh] = ctx->inputs.emplace(ctx->dependencies[i], input_frames[i]); !fresh && !it->second)
+            it->second = input_frames[i];
+    if (exclusive)
+        flush_drops();
+    auto call = [&](int reason) {
+        auto frame = getFrame(static_cast<int>(ctx->frame_idx), reason, &instanceData, &ctx->vs_frame_data, ctx.get(),
+                              core.get(), &api);
+        if (auto err = ctx->error; err)
+            throw_filter_error(err);
+        return std::unique_ptr<VSFrameRef>(const_cast<VSFrameRef*>(frame));
+    };
+    std::unique_ptr<VSFrameRef> frame_ref;
+    auto requested = ctx->requests.size();
+    if (is_source_filter || (exclusive && !requested))
+        frame_ref = call(arInitial);
+    else {
+        // like VapourSynth, frames arriving while others are pending are announced with arFrameReady
+        for (auto i = ctx->delivered; i + 1 < ctx->dependency_count && ctx->requests.size() == requested; ++i) {
+            // announced before the call so that queryCompletedFrame and releaseFrameEarly already see it
+            ctx->completed = i;
+            ctx->delivered = i + 1;
+            call(arFrameReady);
+        }
+        ctx->delivered = ctx->dependency_count;
+        if (ctx->requests.size() == requested) {
+            ctx->completed = ctx->dependency_count - 1;
+            frame_ref = call(arAllFramesReady);
+        }
+    }
+    if (!frame_ref && ctx->requests.size() > requested) {
+        // another round: arAllFramesReady is delivered again once the new requests are ready
+        ctx->dependencies = ctx->requests.data();
+        ctx->dependency_count = ctx->requests.size();
+        *frame_data = ctx.release();
+        *out = nullptr;
+        return;
+    }
+    if (!frame_ref)
+        throw_filter_error("the filter returned no frame");
     *out = frame_ref->frame.detach();
 }
 
 void VSFilter::drop_frame_data(catsyn::FrameData* frame_data) const noexcept {
-    if (frame_data)
-        core->nucl->get_logger()->log(catsyn::LogLevel::WARNING, "VSFilter: frame data leaked");
+    // the frame failed or was cancelled before it was produced; arError lets the filter free its frame data
+    auto ctx = std::unique_ptr<VSFrameContext>(static_cast<VSFrameContext*>(frame_data));
+    if (!ctx || !ctx->vs_frame_data)
+        return;
+    ctx->inputs.clear();
+    if (exclusive) {
+        // called by the maintainer, while another frame of the filter may be running
+        std::lock_guard<std::mutex> lock(drops_mutex);
+        drops.push_back(ctx.release());
+    } else
+        getFrame(static_cast<int>(ctx->frame_idx), arError, &instanceData, &ctx->vs_frame_data, ctx.get(), core.get(),
+                 &api);
+}
+
+void VSFilter::flush_drops() const noexcept {
+    std::vector<VSFrameContext*> pending;
+    {
+        std::lock_guard<std::mutex> lock(drops_mutex);
+        pending.swap(drops);
+    }
+    for (auto ctx : pending) {
+        getFrame(static_cast<int>(ctx->frame_idx), arError, &instanceData, &ctx->vs_frame_data, ctx, core.get(), &api);
+        delete ctx;
+    }
 }
 
 std::atomic_uint* VSFilter::get_thread_init_atomic() noexcept {
@@ -236,13 +318,46 @@ std::atomic_uint* VSFilter::get_thread_init_atomic() noexcept {
 }
 
 void queryCompletedFrame(VSNodeRef** node, int* n, VSFrameContext* frameCtx) noexcept {
-    not_implemented();
+    if (frameCtx->completed < frameCtx->delivered) {
+        *node = frameCtx->request_nodes[frameCtx->completed];
+        *n = static_cast<int>(frameCtx->requests[frameCtx->completed].frame_idx);
+    } else {
+        *node = nullptr;
+        *n = -1;
+    }
 }
 
+// The input stays valid until process_frame returns unless released here, so temporal filters can hand back the
+// frames at the trailing edge of their window as they go.
 void releaseFrameEarly(VSNodeRef* node, int n, VSFrameContext* frameCtx) noexcept {
-    core->nucl->get_logger()->log(catsyn::LogLevel::WARNING, "Metalloporphyrin: not implemented (releaseFrameEarly)");
+    catsyn::FrameSource source{node->substrate.get(), static_cast<size_t>(n)};
+    auto it = frameCtx->inputs.find(source);
+    if (it == frameCtx->inputs.end() || !it->second)
+        return;
+    // kept as a null entry, so that getFrameFilter can tell a released frame from one never requested
+    it->second = nullptr;
+    auto& nucl = dynamic_cast<catsyn::INucleus1&>(*core->nucl);
+    // every input of this round is present, including those not announced yet
+    for (size_t i = 0; i < frameCtx->dependency_count; ++i)
+        if (auto& request = frameCtx->requests[i];
+            request.substrate == source.substrate && request.frame_idx == source.frame_idx)
+            nucl.release_input(i);
 }
 
 int getOutputIndex(VSFrameContext* frameCtx) noexcept {
     return 0;
 }
+
+void runBands(int count, VSBandFunc func, void* userData, VSCore*) noexcept {
+    if (count <= 0)
+        return;
+    std::pair<VSBandFunc, void*> bands{func, userData};
+    dynamic_cast<catsyn::INucleus1&>(*core->nucl)
+        .run_bands(
+            static_cast<unsigned>(count),
+            [](void* user_data, unsigned idx) {
+                auto bands = static_cast<std::pair<VSBandFunc, void*>*>(user_data);
+                bands->first(bands->second, static_cast<int>(idx));
+            },
+            &bands);
+}
@@ -85,6 +85,8 @@ VSFrameRef* newVideoFrame(const VSFormat* format, int width, int height, const V
                           VSCore* core) noexcept;
 VSFrameRef* newVideoFrame2(const VSFormat* format, int width, int height, const VSFrameRef** planeSrc,
                            const int* planes, const VSFrameRef* propSrc, VSCore* core) noexcept;
+VSFrameRef* newVideoFrameView(const VSFrameRef* src, const VSFormat* format, int width, int height,
+                              const int64_t* offsets, const int* strides, VSCore* core) noexcept;
 VSFrameRef* copyFrame(const VSFrameRef* f, VSCore*) noexcept;
 const VSFrameRef* cloneFrameRef(const VSFrameRef* f) noexcept;
 void freeFrame(const VSFrameRef* f) noexcept;
@@ -191,6 +193,7 @@ VSMap* invoke(VSPlugin* plugin, const char* name, const VSMap* args) noexcept;
 void queryCompletedFrame(VSNodeRef** node, int* n, VSFrameContext* frameCtx) noexcept;
 void releaseFrameEarly(VSNodeRef* node, int n, VSFrameContext* frameCtx) noexcept;
 int getOutputIndex(VSFrameContext* frameCtx) noexcept;
+void runBands(int count, VSBandFunc func, void* userData, VSCore* core) noexcept;
 const char* getPluginPath(const VSPlugin* plugin) noexcept;
 
 struct VSRibosome final : Object, virtual catsyn::IRibosome {
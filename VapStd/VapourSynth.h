@@ -245,6 +245,7 @@ typedef void (VS_CC *VSFilterFree)(void *instanceData, VSCore *core, const VSAPI
 typedef void (VS_CC *VSFrameDoneCallback)(void *userData, const VSFrameRef *f, int n, VSNodeRef *, const char *errorMsg);
 typedef void (VS_CC *VSMessageHandler)(int msgType, const char *msg, void *userData);
 typedef void (VS_CC *VSMessageHandlerFree)(void *userData);
+typedef void (VS_CC *VSBandFunc)(void *userData, int band);
 
 struct VSAPI {
     VSCore *(VS_CC *createCore)(int threads) VS_NOEXCEPT;
@@ -352,6 +353,10 @@ struct VSAPI {
     int (VS_CC *addMessageHandler)(VSMessageHandler handler, VSMessageHandlerFree free, void *userData) VS_NOEXCEPT;
     int (VS_CC *removeMessageHandler)(int id) VS_NOEXCEPT;
     void (VS_CC *getCoreInfo2)(VSCore *core, VSCoreInfo *info) VS_NOEXCEPT;
+
+    /* Metalloporphyrin extension, only present when versionString contains "Metalloporphyrin" */
+    VSFrameRef *(VS_CC *newVideoFrameView)(const VSFrameRef *src, const VSFormat *format, int width, int height, const int64_t *offsets, const int *strides, VSCore *core) VS_NOEXCEPT;
+    void (VS_CC *runBands)(int count, VSBandFunc func, void *userData, VSCore *core) VS_NOEXCEPT; /* calls func for every band in [0, count) using idle worker threads, returns when all are done */
 };
 
 VS_API(const VSAPI *) getVapourSynthAPI(int version) VS_NOEXCEPT;
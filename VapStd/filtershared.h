@@ -73,6 +73,42 @@ static inline void setBlack(uint32_t color[3], const VSFormat *format) {
         color[1] = color[2] = 128;
 }
 
+// newVideoFrameView lets frames alias a window of another frame's planes instead of copying them
+static inline int hasFrameViews(VSCore *core, const VSAPI *vsapi) {
+    VSCoreInfo ci;
+    vsapi->getCoreInfo2(core, &ci);
+    return strstr(ci.versionString, "Metalloporphyrin") != NULL;
+}
+
+// SIMD filters rely on plane pointers and strides being aligned like freshly allocated frames, so a view may only
+// be used where every plane stays aligned
+static inline int isViewAligned(const int64_t *offsets, const int *strides, int numPlanes) {
+    for (int plane = 0; plane < numPlanes; plane++)
+        if (offsets[plane] % 64 || strides[plane] % 64)
+            return 0;
+    return 1;
+}
+
+// runBands lets getFrame split a frame into row bands that idle worker threads help with
+static inline int hasBands(VSCore *core, const VSAPI *vsapi) {
+    return hasFrameViews(core, vsapi);
+}
+
+// bands are at least 256K pixels and 64 rows so the split pays for the synchronization
+static inline int bandCount(int width, int height) {
+    int count = VSMIN((int)(((int64_t)width * height) >> 18), height / 64);
+    return VSMAX(VSMIN(count, 16), 1);
+}
+
+static inline void forEachBand(int count, VSBandFunc func, void *userData, int bands, VSCore *core, const VSAPI *vsapi) {
+    if (bands && count > 1) {
+        vsapi->runBands(count, func, userData, core);
+    } else {
+        for (int i = 0; i < count; i++)
+            func(userData, i);
+    }
+}
+
 typedef struct {
     VSNodeRef *node;
     const VSVideoInfo *vi;
@@ -96,6 +96,7 @@ struct GenericData {
     bool saturate;
 
     int cpulevel;
+    bool bands;
 };
 
 template<typename T, typename OP>
@@ -355,6 +356,32 @@ static decltype(&vs_generic_3x3_conv_byte_c) genericSelectC(const VSFormat *fi,
     return nullptr;
 }
 
+struct GenericBands {
+    void (*func)(const void *, ptrdiff_t, void *, ptrdiff_t, const vs_generic_params *, unsigned, unsigned);
+    int numPlanes;
+    int count;
+    const uint8_t *srcp[3];
+    uint8_t *dstp[3];
+    int src_stride[3];
+    int dst_stride[3];
+    unsigned width[3];
+    unsigned height[3];
+    vs_generic_params params[3];
+};
+
+static void VS_CC genericBand(void *userData, int band) {
+    const GenericBands *b = static_cast<const GenericBands *>(userData);
+    for (int plane = 0; plane < b->numPlanes; plane++) {
+        if (!b->dstp[plane])
+            continue;
+        vs_generic_params params = b->params[plane];
+        params.row_begin = b->height[plane] * band / b->count;
+        params.row_end = b->height[plane] * (band + 1) / b->count;
+        if (params.row_begin < params.row_end)
+            b->func(b->srcp[plane], b->src_stride[plane], b->dstp[plane], b->dst_stride[plane], &params, b->width[plane], b->height[plane]);
+    }
+}
+
 template <GenericOperations op>
 static const VSFrameRef *VS_CC genericGetframe(int n, int activationReason, void **instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
     GenericData *d = static_cast<GenericData *>(*instanceData);
@@ -385,29 +412,33 @@ static const VSFrameRef *VS_CC genericGetframe(int n, int activationReason, void
 
         VSFrameRef *dst = vsapi->newVideoFrame2(fi, vsapi->getFrameWidth(src, 0), vsapi->getFrameHeight(src, 0), fr, pl, src, core);
 
-        void (*func)(const void *, ptrdiff_t, void *, ptrdiff_t, const vs_generic_params *, unsigned, unsigned) = nullptr;
+        GenericBands b{};
 
 #ifdef VS_TARGET_CPU_X86
         if (getCPUFeatures()->avx2 && d->cpulevel >= VS_CPU_LEVEL_AVX2)
-            func = genericSelectAVX2<op>(fi, d);
-        if (!func && d->cpulevel >= VS_CPU_LEVEL_SSE2)
-            func = genericSelectSSE2<op>(fi, d);
+            b.func = genericSelectAVX2<op>(fi, d);
+        if (!b.func && d->cpulevel >= VS_CPU_LEVEL_SSE2)
+            b.func = genericSelectSSE2<op>(fi, d);
 #endif
-        if (!func)
-            func = genericSelectC<op>(fi, d);
-
-        for (int plane = 0; plane < fi->numPlanes; plane++) {
-            if (func && d->process[plane]) {
-                uint8_t *dstp = vsapi->getWritePtr(dst, plane);
-                const uint8_t *srcp = vsapi->getReadPtr(src, plane);
-                int width = vsapi->getFrameWidth(src, plane);
-                int height = vsapi->getFrameHeight(src, plane);
-                int src_stride = vsapi->getStride(src, plane);
-                int dst_stride = vsapi->getStride(dst, plane);
-
-                vs_generic_params params = make_generic_params(d, fi, plane);
-                func(srcp, src_stride, dstp, dst_stride, &params, width, height);
+        if (!b.func)
+            b.func = genericSelectC<op>(fi, d);
+
+        if (b.func) {
+            b.numPlanes = fi->numPlanes;
+            for (int plane = 0; plane < fi->numPlanes; plane++) {
+                if (d->process[plane]) {
+                    b.dstp[plane] = vsapi->getWritePtr(dst, plane);
+                    b.srcp[plane] = vsapi->getReadPtr(src, plane);
+                    b.width[plane] = vsapi->getFrameWidth(src, plane);
+                    b.height[plane] = vsapi->getFrameHeight(src, plane);
+                    b.src_stride[plane] = vsapi->getStride(src, plane);
+                    b.dst_stride[plane] = vsapi->getStride(dst, plane);
+                    b.params[plane] = make_generic_params(d, fi, plane);
+                }
             }
+
+            b.count = d->bands ? bandCount(vsapi->getFrameWidth(src, 0), vsapi->getFrameHeight(src, 0)) : 1;
+            forEachBand(b.count, genericBand, &b, d->bands, core, vsapi);
         }
 
         vsapi->freeFrame(src);
@@ -589,6 +620,7 @@ static void VS_CC genericCreate(const VSMap *in, VSMap *out, void *userData, VSC
             throw std::runtime_error("Height must be bigger than convolution radius.");
 
         d->cpulevel = vs_get_cpulevel(core);
+        d->bands = !!hasBands(core, vsapi);
     } catch (const std::runtime_error &error) {
         vsapi->freeNode(d->node);
         vsapi->setError(out, (d->filter_name + ": "_s + error.what()).c_str());
@@ -245,7 +245,9 @@ void filter_plane_3x3(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_
     Traits traits{ params };
     uint16_t maxval = params.maxval;
 
-    for (unsigned i = 0; i < height; ++i) {
+    unsigned row_end = vs_generic_row_end(&params, height);
+
+    for (unsigned i = params.row_begin; i < row_end; ++i) {
         unsigned above_idx = i == 0 ? std::min(1U, height - 1) : i - 1;
         unsigned below_idx = i == height - 1 ? height - std::min(2U, height) : i + 1;
 
@@ -294,7 +296,9 @@ void conv_plane_5x5(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t
     float bias = params.bias;
     bool saturate = params.saturate;
 
-    for (unsigned i = 0; i < height; ++i) {
+    unsigned row_end = vs_generic_row_end(&params, height);
+
+    for (unsigned i = params.row_begin; i < row_end; ++i) {
         unsigned dist_from_bottom = height - 1 - i;
 
         unsigned above2_idx = i < 2 ? std::min(2 - i, height - 1) : i - 2;
@@ -392,7 +396,9 @@ void conv_plane_h(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t ds
     float bias = params.bias;
     bool saturate = params.saturate;
 
-    for (unsigned i = 0; i < height; ++i) {
+    unsigned row_end = vs_generic_row_end(&params, height);
+
+    for (unsigned i = params.row_begin; i < row_end; ++i) {
         const T *srcp = static_cast<const T * >(line_ptr(src, i, src_stride));
         T *dstp = static_cast<T *>(line_ptr(dst, i, dst_stride));
 
@@ -464,7 +470,9 @@ void conv_plane_v(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t ds
     float bias = params.bias;
     bool saturate = params.saturate;
 
-    for (unsigned i = 0; i < std::min(height, support); ++i) {
+    unsigned row_end = vs_generic_row_end(&params, height);
+
+    for (unsigned i = params.row_begin; i < std::min(std::min(height, support), row_end); ++i) {
         T *dstp = static_cast<T *>(line_ptr(dst, i, dst_stride));
 
         unsigned dist_from_bottom = height - 1 - i;
@@ -489,7 +497,7 @@ void conv_plane_v(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t ds
             dstp[j] = limit(xrint<T>(tmp), maxval);
         }
     }
-    for (unsigned i = support; i < height - std::min(height, support); ++i) {
+    for (unsigned i = std::max(support, params.row_begin); i < std::min(height - std::min(height, support), row_end); ++i) {
         T *dstp = static_cast<T *>(line_ptr(dst, i, dst_stride));
 
         for (unsigned j = 0; j < width; ++j) {
@@ -504,7 +512,7 @@ void conv_plane_v(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t ds
             dstp[j] = limit(xrint<T>(tmp), maxval);
         }
     }
-    for (unsigned i = std::max(support, height - std::min(height, support)); i < height; ++i) {
+    for (unsigned i = std::max(std::max(support, height - std::min(height, support)), params.row_begin); i < row_end; ++i) {
         T *dstp = static_cast<T *>(line_ptr(dst, i, dst_stride));
 
         unsigned dist_from_bottom = height - 1 - i;
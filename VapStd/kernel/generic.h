@@ -48,8 +48,17 @@ struct vs_generic_params {
 	float div;
 	float bias;
 	uint8_t saturate;
+
+	/* Rows [row_begin, row_end) of the plane are produced, so a frame can be split into bands. 0 means height. */
+	unsigned row_begin;
+	unsigned row_end;
 };
 
+static inline unsigned vs_generic_row_end(const struct vs_generic_params *params, unsigned height)
+{
+	return params->row_end && params->row_end < height ? params->row_end : height;
+}
+
 #define DECL(kernel, pixel, isa) void vs_generic_##kernel##_##pixel##_##isa(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_t dst_stride, const struct vs_generic_params *params, unsigned width, unsigned height);
 #define DECL_3x3(kernel, pixel, isa) DECL(3x3_##kernel, pixel, isa)
 
@@ -960,8 +960,10 @@ void filter_plane_3x3(const void *src, ptrdiff_t src_stride, void *dst, ptrdiff_
 
     unsigned vec_end = (width - 1) & ~(Traits::vec_len - 1);
 
+    unsigned row_end = vs_generic_row_end(&params, height);
+
 #define INVOKE(p0, p1, p2) (traits.op(Traits::loadu(p0 - 1), Traits::load(p0), Traits::loadu(p0 + 1), Traits::loadu(p1 - 1), Traits::load(p1), Traits::loadu(p1 + 1), Traits::loadu(p2 - 1), Traits::load(p2), Traits::loadu(p2 + 1)))
-    for (unsigned i = 0; i < height; ++i) {
+    for (unsigned i = params.row_begin; i < row_end; ++i) {
         unsigned above_idx = i == 0 ? std::min(1U, height - 1) : i - 1;
         unsigned below_idx = i == height - 1 ? height - std::min(2U, height) : i + 1;
 
@@ -226,6 +226,7 @@ typedef struct {
     float fweight[3];
     int process[3];
     int cpulevel;
+    int bands;
 } MergeData;
 
 const unsigned MergeShift = 15;
@@ -235,6 +236,26 @@ static void VS_CC mergeInit(VSMap *in, VSMap *out, void **instanceData, VSNode *
     vsapi->setVideoInfo(d->vi, 1, node);
 }
 
+typedef struct {
+    void (*func)(const void *, const void *, void *, union vs_merge_weight, unsigned);
+    const uint8_t *srcp1;
+    const uint8_t *srcp2;
+    uint8_t *dstp;
+    union vs_merge_weight weight;
+    int w;
+    int h;
+    int stride;
+    int count;
+} MergeBand;
+
+static void VS_CC mergeBand(void *userData, int band) {
+    const MergeBand *b = (const MergeBand *)userData;
+    for (int y = b->h * band / b->count; y < b->h * (band + 1) / b->count; ++y) {
+        ptrdiff_t offset = (ptrdiff_t)y * b->stride;
+        b->func(b->srcp1 + offset, b->srcp2 + offset, b->dstp + offset, b->weight, b->w);
+    }
+}
+
 static const VSFrameRef *VS_CC mergeGetFrame(int n, int activationReason, void **instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
     MergeData *d = (MergeData *)*instanceData;
 
@@ -295,12 +316,8 @@ static const VSFrameRef *VS_CC mergeGetFrame(int n, int activationReason, void *
                 else
                     weight.f = d->fweight[plane];
 
-                for (int y = 0; y < h; ++y) {
-                    func(srcp1, srcp2, dstp, weight, w);
-                    srcp1 += stride;
-                    srcp2 += stride;
-                    dstp += stride;
-                }
+                MergeBand b = { func, srcp1, srcp2, dstp, weight, w, h, stride, d->bands ? bandCount(w, h) : 1 };
+                forEachBand(b.count, mergeBand, &b, d->bands, core, vsapi);
             }
         }
 
@@ -364,6 +381,7 @@ static void VS_CC mergeCreate(const VSMap *in, VSMap *out, void *userData, VSCor
     }
 
     d.cpulevel = vs_get_cpulevel(core);
+    d.bands = hasBands(core, vsapi);
 
     if (isCompatFormat(d.vi) || isCompatFormat(vsapi->getVideoInfo(d.node2))) {
         vsapi->freeNode(d.node1);
@@ -409,6 +427,7 @@ typedef struct {
     int first_plane;
     int process[3];
     int cpulevel;
+    int bands;
 } MaskedMergeData;
 
 static void VS_CC maskedMergeInit(VSMap *in, VSMap *out, void **instanceData, VSNode *node, VSCore *core, const VSAPI *vsapi) {
@@ -416,6 +435,28 @@ static void VS_CC maskedMergeInit(VSMap *in, VSMap *out, void **instanceData, VS
     vsapi->setVideoInfo(d->vi, 1, node);
 }
 
+typedef struct {
+    void (*func)(const void *, const void *, const void *, void *, unsigned, unsigned, unsigned);
+    const uint8_t *srcp1;
+    const uint8_t *srcp2;
+    const uint8_t *maskp;
+    uint8_t *dstp;
+    unsigned depth;
+    unsigned offset;
+    int w;
+    int h;
+    int stride;
+    int count;
+} MaskedMergeBand;
+
+static void VS_CC maskedMergeBand(void *userData, int band) {
+    const MaskedMergeBand *b = (const MaskedMergeBand *)userData;
+    for (int y = b->h * band / b->count; y < b->h * (band + 1) / b->count; y++) {
+        ptrdiff_t offset = (ptrdiff_t)y * b->stride;
+        b->func(b->srcp1 + offset, b->srcp2 + offset, b->maskp + offset, b->dstp + offset, b->depth, b->offset, b->w);
+    }
+}
+
 static const VSFrameRef *VS_CC maskedMergeGetFrame(int n, int activationReason, void **instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
     MaskedMergeData *d = (MaskedMergeData *) * instanceData;
 
@@ -493,13 +534,8 @@ static const VSFrameRef *VS_CC maskedMergeGetFrame(int n, int activationReason,
 
                 int depth = d->vi->format->bitsPerSample;
 
-                for (int y = 0; y < h; y++) {
-                    func(srcp1, srcp2, maskp, dstp, depth, yuvhandling ? (1 << (depth - 1)) : offset1, w);
-                    srcp1 += stride;
-                    srcp2 += stride;
-                    maskp += stride;
-                    dstp += stride;
-                }
+                MaskedMergeBand b = { func, srcp1, srcp2, maskp, dstp, depth, yuvhandling ? (1 << (depth - 1)) : offset1, w, h, stride, d->bands ? bandCount(w, h) : 1 };
+                forEachBand(b.count, maskedMergeBand, &b, d->bands, core, vsapi);
             }
         }
         vsapi->freeFrame(src1);
@@ -624,6 +660,7 @@ static void VS_CC maskedMergeCreate(const VSMap *in, VSMap *out, void *userData,
     }
 
     d.cpulevel = vs_get_cpulevel(core);
+    d.bands = hasBands(core, vsapi);
 
     data = malloc(sizeof(d));
     *data = d;
@@ -640,6 +677,7 @@ typedef struct {
     const VSVideoInfo *vi;
     int process[3];
     int cpulevel;
+    int bands;
 } MakeDiffData;
 
 static void VS_CC makeDiffInit(VSMap *in, VSMap *out, void **instanceData, VSNode *node, VSCore *core, const VSAPI *vsapi) {
@@ -647,6 +685,26 @@ static void VS_CC makeDiffInit(VSMap *in, VSMap *out, void **instanceData, VSNod
     vsapi->setVideoInfo(d->vi, 1, node);
 }
 
+typedef struct {
+    void (*func)(const void *, const void *, void *, unsigned, unsigned);
+    const uint8_t *srcp1;
+    const uint8_t *srcp2;
+    uint8_t *dstp;
+    unsigned depth;
+    int w;
+    int h;
+    int stride;
+    int count;
+} DiffBand;
+
+static void VS_CC diffBand(void *userData, int band) {
+    const DiffBand *b = (const DiffBand *)userData;
+    for (int y = b->h * band / b->count; y < b->h * (band + 1) / b->count; ++y) {
+        ptrdiff_t offset = (ptrdiff_t)y * b->stride;
+        b->func(b->srcp1 + offset, b->srcp2 + offset, b->dstp + offset, b->depth, b->w);
+    }
+}
+
 static const VSFrameRef *VS_CC makeDiffGetFrame(int n, int activationReason, void **instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
     MakeDiffData *d = (MakeDiffData *)*instanceData;
 
@@ -702,12 +760,8 @@ static const VSFrameRef *VS_CC makeDiffGetFrame(int n, int activationReason, voi
 
                 int depth = d->vi->format->bitsPerSample;
 
-                for (int y = 0; y < h; ++y) {
-                    func(srcp1, srcp2, dstp, depth, w);
-                    srcp1 += stride;
-                    srcp2 += stride;
-                    dstp += stride;
-                }
+                DiffBand b = { func, srcp1, srcp2, dstp, depth, w, h, stride, d->bands ? bandCount(w, h) : 1 };
+                forEachBand(b.count, diffBand, &b, d->bands, core, vsapi);
             }
         }
 
@@ -779,6 +833,7 @@ static void VS_CC makeDiffCreate(const VSMap *in, VSMap *out, void *userData, VS
     }
 
     d.cpulevel = vs_get_cpulevel(core);
+    d.bands = hasBands(core, vsapi);
 
     data = malloc(sizeof(d));
     *data = d;
@@ -795,6 +850,7 @@ typedef struct {
     const VSVideoInfo *vi;
     int process[3];
     int cpulevel;
+    int bands;
 } MergeDiffData;
 
 static void VS_CC mergeDiffInit(VSMap *in, VSMap *out, void **instanceData, VSNode *node, VSCore *core, const VSAPI *vsapi) {
@@ -857,12 +913,8 @@ static const VSFrameRef *VS_CC mergeDiffGetFrame(int n, int activationReason, vo
 
                 int depth = d->vi->format->bitsPerSample;
 
-                for (int y = 0; y < h; ++y) {
-                    func(srcp1, srcp2, dstp, depth, w);
-                    srcp1 += stride;
-                    srcp2 += stride;
-                    dstp += stride;
-                }
+                DiffBand b = { func, srcp1, srcp2, dstp, depth, w, h, stride, d->bands ? bandCount(w, h) : 1 };
+                forEachBand(b.count, diffBand, &b, d->bands, core, vsapi);
             }
         }
 
@@ -933,6 +985,7 @@ static void VS_CC mergeDiffCreate(const VSMap *in, VSMap *out, void *userData, V
     }
 
     d.cpulevel = vs_get_cpulevel(core);
+    d.bands = hasBands(core, vsapi);
 
     data = malloc(sizeof(d));
     *data = d;
@@ -140,6 +140,7 @@ typedef struct {
     int y;
     int width;
     int height;
+    int view;
 } CropData;
 
 static void VS_CC cropInit(VSMap *in, VSMap *out, void **instanceData, VSNode *node, VSCore *core, const VSAPI *vsapi) {
@@ -199,16 +200,32 @@ static const VSFrameRef *VS_CC cropGetframe(int n, int activationReason, void **
             return NULL;
         }
 
-        VSFrameRef *dst = vsapi->newVideoFrame(fi, d->width, d->height, src, core);
+        VSFrameRef *dst = NULL;
 
-        for (int plane = 0; plane < fi->numPlanes; plane++) {
-            int srcstride = vsapi->getStride(src, plane);
-            int dststride = vsapi->getStride(dst, plane);
-            const uint8_t *srcdata = vsapi->getReadPtr(src, plane);
-            uint8_t *dstdata = vsapi->getWritePtr(dst, plane);
-            srcdata += srcstride * (y >> (plane ? fi->subSamplingH : 0));
-            srcdata += (d->x >> (plane ? fi->subSamplingW : 0)) * fi->bytesPerSample;
-            vs_bitblt(dstdata, dststride, srcdata, srcstride, (d->width >> (plane ? fi->subSamplingW : 0)) * fi->bytesPerSample, vsapi->getFrameHeight(dst, plane));
+        if (d->view) {
+            int64_t offsets[3];
+            int strides[3];
+            for (int plane = 0; plane < fi->numPlanes; plane++) {
+                strides[plane] = vsapi->getStride(src, plane);
+                offsets[plane] = (int64_t)strides[plane] * (y >> (plane ? fi->subSamplingH : 0));
+                offsets[plane] += (d->x >> (plane ? fi->subSamplingW : 0)) * fi->bytesPerSample;
+            }
+            if (isViewAligned(offsets, strides, fi->numPlanes))
+                dst = vsapi->newVideoFrameView(src, fi, d->width, d->height, offsets, strides, core);
+        }
+
+        if (!dst) {
+            dst = vsapi->newVideoFrame(fi, d->width, d->height, src, core);
+
+            for (int plane = 0; plane < fi->numPlanes; plane++) {
+                int srcstride = vsapi->getStride(src, plane);
+                int dststride = vsapi->getStride(dst, plane);
+                const uint8_t *srcdata = vsapi->getReadPtr(src, plane);
+                uint8_t *dstdata = vsapi->getWritePtr(dst, plane);
+                srcdata += srcstride * (y >> (plane ? fi->subSamplingH : 0));
+                srcdata += (d->x >> (plane ? fi->subSamplingW : 0)) * fi->bytesPerSample;
+                vs_bitblt(dstdata, dststride, srcdata, srcstride, (d->width >> (plane ? fi->subSamplingW : 0)) * fi->bytesPerSample, vsapi->getFrameHeight(dst, plane));
+            }
         }
 
         vsapi->freeFrame(src);
@@ -251,6 +268,8 @@ static void VS_CC cropAbsCreate(const VSMap *in, VSMap *out, void *userData, VSC
         RETERROR(msg);
     }
 
+    d.view = hasFrameViews(core, vsapi);
+
     data = malloc(sizeof(d));
     *data = d;
 
@@ -289,6 +308,8 @@ static void VS_CC cropRelCreate(const VSMap *in, VSMap *out, void *userData, VSC
         RETERROR(msg);
     }
 
+    d.view = hasFrameViews(core, vsapi);
+
     data = malloc(sizeof(d));
     *data = d;
 
@@ -694,6 +715,7 @@ typedef struct {
     VSVideoInfo vi;
     int tff;
     int modifyDuration;
+    int view;
 } SeparateFieldsData;
 
 static void VS_CC separateFieldsInit(VSMap *in, VSMap *out, void **instanceData, VSNode *node, VSCore *core, const VSAPI *vsapi) {
@@ -722,20 +744,37 @@ static const VSFrameRef *VS_CC separateFieldsGetframe(int n, int activationReaso
             return NULL;
         }
 
-        VSFrameRef *dst = vsapi->newVideoFrame(d->vi.format, d->vi.width, d->vi.height, src, core);
-        const VSFormat *fi = vsapi->getFrameFormat(dst);
+        VSFrameRef *dst = NULL;
 
-        for (int plane = 0; plane < fi->numPlanes; plane++) {
-            const uint8_t *srcp = vsapi->getReadPtr(src, plane);
-            int src_stride = vsapi->getStride(src, plane);
-            uint8_t *dstp = vsapi->getWritePtr(dst, plane);
-            int dst_stride = vsapi->getStride(dst, plane);
+        if (d->view) {
+            const VSFormat *fi = d->vi.format;
+            int64_t offsets[3];
+            int strides[3];
+            for (int plane = 0; plane < fi->numPlanes; plane++) {
+                int src_stride = vsapi->getStride(src, plane);
+                offsets[plane] = !((n & 1) ^ effectiveTFF) ? src_stride : 0;
+                strides[plane] = src_stride * 2;
+            }
+            if (isViewAligned(offsets, strides, fi->numPlanes))
+                dst = vsapi->newVideoFrameView(src, fi, d->vi.width, d->vi.height, offsets, strides, core);
+        }
+
+        if (!dst) {
+            dst = vsapi->newVideoFrame(d->vi.format, d->vi.width, d->vi.height, src, core);
+            const VSFormat *fi = vsapi->getFrameFormat(dst);
 
-            if (!((n & 1) ^ effectiveTFF))
-                srcp += src_stride;
-            src_stride *= 2;
+            for (int plane = 0; plane < fi->numPlanes; plane++) {
+                const uint8_t *srcp = vsapi->getReadPtr(src, plane);
+                int src_stride = vsapi->getStride(src, plane);
+                uint8_t *dstp = vsapi->getWritePtr(dst, plane);
+                int dst_stride = vsapi->getStride(dst, plane);
 
-            vs_bitblt(dstp, dst_stride, srcp, src_stride, vsapi->getFrameWidth(dst, plane) * fi->bytesPerSample, vsapi->getFrameHeight(dst, plane));
+                if (!((n & 1) ^ effectiveTFF))
+                    srcp += src_stride;
+                src_stride *= 2;
+
+                vs_bitblt(dstp, dst_stride, srcp, src_stride, vsapi->getFrameWidth(dst, plane) * fi->bytesPerSample, vsapi->getFrameHeight(dst, plane));
+            }
         }
 
         vsapi->freeFrame(src);
@@ -795,6 +834,8 @@ static void VS_CC separateFieldsCreate(const VSMap *in, VSMap *out, void *userDa
     if (d.modifyDuration)
         muldivRational(&d.vi.fpsNum, &d.vi.fpsDen, 2, 1);
 
+    d.view = hasFrameViews(core, vsapi);
+
     data = malloc(sizeof(d));
     *data = d;
 
@@ -2515,6 +2556,35 @@ static void VS_CC setMaxCpu(const VSMap *in, VSMap *out, void *userData, VSCore
     vsapi->propSetData(out, "cpu", str, (int)strlen(str), paReplace);
 }
 
+//////////////////////////////////////////
+// Cache
+
+static const VSFrameRef *VS_CC cacheGetframe(int n, int activationReason, void **instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
+    SingleClipData *d = (SingleClipData *) * instanceData;
+
+    if (activationReason == arInitial) {
+        vsapi->requestFrameFilter(n, d->node, frameCtx);
+    } else if (activationReason == arAllFramesReady) {
+        return vsapi->getFrameFilter(n, d->node, frameCtx);
+    }
+
+    return 0;
+}
+
+static void VS_CC cacheCreate(const VSMap *in, VSMap *out, void *userData, VSCore *core, const VSAPI *vsapi) {
+    SingleClipData d;
+    SingleClipData *data;
+    int err;
+
+    // size and fixed only tune the cache of the reference core, frames are cached by the host here
+    int makeLinear = !!vsapi->propGetInt(in, "make_linear", 0, &err);
+    d.node = vsapi->propGetNode(in, "clip", 0, NULL);
+    data = malloc(sizeof(d));
+    *data = d;
+
+    vsapi->createFilter(in, out, "Cache", singleClipInit, cacheGetframe, singleClipFree, fmParallel, nfIsCache | (makeLinear ? nfMakeLinear : 0), data, core);
+}
+
 //////////////////////////////////////////
 // Init
 
@@ -2544,4 +2614,5 @@ void VS_CC stdlibInitialize(VSConfigPlugin configFunc, VSRegisterFunction regist
     registerFunc("SetFrameProp", "clip:clip;prop:data;delete:int:opt;intval:int[]:opt;floatval:float[]:opt;data:data[]:opt;", setFramePropCreate, 0, plugin);
     registerFunc("SetFieldBased", "clip:clip;value:int;", setFieldBasedCreate, 0, plugin);
     registerFunc("SetMaxCPU", "cpu:data;", setMaxCpu, 0, plugin);
+    registerFunc("Cache", "clip:clip;size:int:opt;fixed:int:opt;make_linear:int:opt;", cacheCreate, 0, plugin);
 }